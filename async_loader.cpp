@@ -0,0 +1,283 @@
+#include "async_loader.h"
+#include "stb_image.h" // implementation lives in nucleus.cpp (or the host program)
+
+#include <algorithm>
+#include <cstdlib>
+#include <malloc.h>
+
+#ifdef NUCLEUS_HOST
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#else
+#include <pspkernel.h>
+#include <pspiofilemgr.h>
+#include <pspthreadman.h>
+#endif
+
+namespace nucleus
+{
+#ifdef NUCLEUS_HOST
+	struct loader_worker
+	{
+		std::thread thread;
+		std::mutex queue_lock;
+		std::mutex work_lock; // work_count and work_ready make a counting semaphore, like the PSP side
+		std::condition_variable work_ready;
+		unsigned int work_count;
+	};
+
+	typedef FILE *file_handle;
+
+	static void startWorker(loader_worker *worker, async_loader *loader)
+	{
+		worker->work_count = 0;
+		worker->thread = std::thread([loader]() { loader->run(); });
+	}
+
+	static void joinWorker(loader_worker *worker)
+	{
+		worker->thread.join();
+	}
+
+	static void lockQueues(loader_worker *worker) { worker->queue_lock.lock(); }
+	static void unlockQueues(loader_worker *worker) { worker->queue_lock.unlock(); }
+
+	static void signalWork(loader_worker *worker)
+	{
+		{
+			std::lock_guard<std::mutex> guard(worker->work_lock);
+			worker->work_count++;
+		}
+		worker->work_ready.notify_one();
+	}
+
+	static void waitWork(loader_worker *worker)
+	{
+		std::unique_lock<std::mutex> guard(worker->work_lock);
+		worker->work_ready.wait(guard, [worker]() { return worker->work_count > 0; });
+		worker->work_count--;
+	}
+
+	static unsigned int timeMicros(void)
+	{
+		return (unsigned int)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static bool openFile(const char *filename, file_handle &file) { file = fopen(filename, "rb"); return file != nullptr; }
+	static void closeFile(file_handle file) { fclose(file); }
+	static void seekFile(file_handle file, unsigned int offset) { fseek(file, offset, SEEK_SET); }
+
+	static unsigned int fileSize(file_handle file)
+	{
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		return (size > 0) ? (unsigned int)size : 0;
+	}
+
+	static bool readFile(file_handle file, void *dest, unsigned int size)
+	{
+		return fread(dest, 1, size, file) == size;
+	}
+#else
+	struct loader_worker
+	{
+		SceUID thread;
+		SceUID queue_lock; // binary semaphore
+		SceUID work; // counts requests waiting for the worker, plus one to wake it for stopping
+	};
+
+	typedef SceUID file_handle;
+
+	static int workerEntry(SceSize args, void *argp)
+	{
+		(*(async_loader **)argp)->run();
+		return 0;
+	}
+
+	static void startWorker(loader_worker *worker, async_loader *loader)
+	{
+		worker->queue_lock = sceKernelCreateSema("nucleus_loader_lock", 0, 1, 1, nullptr);
+		worker->work = sceKernelCreateSema("nucleus_loader_work", 0, 0, 0x7FFFFFFF, nullptr);
+		worker->thread = sceKernelCreateThread("nucleus_loader", workerEntry, ASYNC_LOADER_PRIORITY, ASYNC_LOADER_STACK_SIZE, PSP_THREAD_ATTR_USER | PSP_THREAD_ATTR_VFPU, nullptr); // texconv copies through the VFPU
+		if (worker->thread >= 0) {
+			sceKernelStartThread(worker->thread, sizeof(loader), &loader); // the argument block is copied to the new thread
+		}
+	}
+
+	static void joinWorker(loader_worker *worker)
+	{
+		if (worker->thread >= 0) {
+			sceKernelWaitThreadEnd(worker->thread, nullptr);
+			sceKernelDeleteThread(worker->thread);
+		}
+		sceKernelDeleteSema(worker->work);
+		sceKernelDeleteSema(worker->queue_lock);
+	}
+
+	static void lockQueues(loader_worker *worker) { sceKernelWaitSema(worker->queue_lock, 1, nullptr); }
+	static void unlockQueues(loader_worker *worker) { sceKernelSignalSema(worker->queue_lock, 1); }
+	static void signalWork(loader_worker *worker) { sceKernelSignalSema(worker->work, 1); }
+	static void waitWork(loader_worker *worker) { sceKernelWaitSema(worker->work, 1, nullptr); }
+
+	static unsigned int timeMicros(void)
+	{
+		return sceKernelGetSystemTimeLow();
+	}
+
+	static bool openFile(const char *filename, file_handle &file) { file = sceIoOpen(filename, PSP_O_RDONLY, 0777); return file >= 0; }
+	static void closeFile(file_handle file) { sceIoClose(file); }
+	static void seekFile(file_handle file, unsigned int offset) { sceIoLseek32(file, offset, PSP_SEEK_SET); }
+
+	static unsigned int fileSize(file_handle file)
+	{
+		int size = sceIoLseek32(file, 0, PSP_SEEK_END);
+		sceIoLseek32(file, 0, PSP_SEEK_SET);
+		return (size > 0) ? (unsigned int)size : 0;
+	}
+
+	// the worker sleeps in sceIoWaitAsync while the transfer runs, leaving the CPU to the game
+	static bool readFile(file_handle file, void *dest, unsigned int size)
+	{
+		if (sceIoReadAsync(file, dest, size) < 0) { return false; }
+		SceInt64 result = 0;
+		sceIoWaitAsync(file, &result);
+		return result == (SceInt64)size;
+	}
+#endif
+
+	async_loader::async_loader()
+	{
+		next_id = 1, pending = 0;
+		stopping = false;
+		worker = new loader_worker();
+		startWorker(worker, this);
+	}
+
+	async_loader::~async_loader()
+	{
+		lockQueues(worker);
+		stopping = true;
+		requests.clear();
+		unlockQueues(worker);
+		signalWork(worker);
+		joinWorker(worker);
+		delete worker;
+		for (loaded_image &image : finished) {
+			free(image.data);
+			free(image.clut);
+		}
+	}
+
+	unsigned int async_loader::request(const std::string &filename, int psm, bool dither)
+	{
+		lockQueues(worker);
+		unsigned int id = next_id++;
+		requests.push_back({id, filename, psm, dither});
+		pending++;
+		unlockQueues(worker);
+		signalWork(worker);
+		return id;
+	}
+
+	bool async_loader::poll(loaded_image &image)
+	{
+		lockQueues(worker);
+		bool ready = !finished.empty();
+		if (ready) {
+			image = finished.front();
+			finished.pop_front();
+			pending--;
+		}
+		unlockQueues(worker);
+		return ready;
+	}
+
+	unsigned int async_loader::getPending(void)
+	{
+		lockQueues(worker);
+		unsigned int count = pending;
+		unlockQueues(worker);
+		return count;
+	}
+
+	void async_loader::run(void)
+	{
+		while (true) {
+			waitWork(worker);
+			lockQueues(worker);
+			if (stopping) {
+				unlockQueues(worker);
+				break;
+			}
+			if (requests.empty()) { // request() signals after queueing, so this only follows a stop that raced it
+				unlockQueues(worker);
+				continue;
+			}
+			load_request request = requests.front();
+			requests.pop_front();
+			unlockQueues(worker);
+
+			loaded_image image;
+			load(request, image);
+
+			lockQueues(worker);
+			finished.push_back(image);
+			unlockQueues(worker);
+		}
+	}
+
+	void async_loader::load(const load_request &request, loaded_image &image)
+	{
+		unsigned int start = timeMicros();
+		image = {};
+		image.id = request.id;
+		file_handle file;
+		if (!openFile(request.filename.c_str(), file)) { return; }
+		unsigned int size = fileSize(file);
+
+		// baked files are read straight into their final buffers, anything else is decoded from memory
+		unsigned char header[sizeof(texconv::ntx_header)];
+		unsigned int header_bytes = std::min(size, (unsigned int)sizeof(header)), header_size = 0;
+		bool baked = readFile(file, header, header_bytes) && texconv::readHeader(header, header_bytes, image.layout, header_size);
+		if (baked) {
+			seekFile(file, header_size);
+			image.data = memalign(16, image.layout.data_size);
+			image.clut = (image.layout.clut_entries > 0) ? (unsigned int *)memalign(16, image.layout.clut_entries * 4) : nullptr;
+			image.ok = image.data != nullptr && readFile(file, image.data, image.layout.data_size);
+			if (image.ok && image.layout.clut_entries > 0) {
+				image.ok = image.clut != nullptr && readFile(file, image.clut, image.layout.clut_entries * 4);
+			}
+		} else {
+			unsigned char *encoded = (unsigned char *)malloc(size);
+			seekFile(file, 0);
+			int width = 0, height = 0, channels;
+			unsigned int *pixels = nullptr;
+			if (encoded != nullptr && readFile(file, encoded, size)) {
+				pixels = (unsigned int *)stbi_load_from_memory(encoded, size, &width, &height, &channels, STBI_rgb_alpha);
+			}
+			free(encoded);
+			if (pixels != nullptr) {
+				int psm = (request.psm < 0) ? texconv::smallestIndexed(pixels, width, height) : request.psm;
+				image.layout = texconv::layoutFor(psm, width, height);
+				image.data = memalign(16, image.layout.data_size);
+				image.clut = (image.layout.clut_entries > 0) ? (unsigned int *)memalign(16, image.layout.clut_entries * 4) : nullptr;
+				image.ok = image.data != nullptr && (image.layout.clut_entries == 0 || image.clut != nullptr);
+				if (image.ok) {
+					texconv::convertImage(pixels, image.layout, request.dither, image.data, image.clut);
+				}
+				stbi_image_free(pixels);
+			}
+		}
+		closeFile(file);
+		if (!image.ok) {
+			free(image.data);
+			free(image.clut);
+			image.data = nullptr, image.clut = nullptr;
+		}
+		image.load_us = timeMicros() - start;
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "texconv.h"
+
+#include <deque>
+#include <string>
+
+#define ASYNC_LOADER_PRIORITY 0x30 // below the main thread (0x20), the worker runs while the game waits on vblank or the GE
+#define ASYNC_LOADER_STACK_SIZE (256 * 1024)
+
+/*
+* Background texture loading. A worker thread reads files (sceIoReadAsync, so it sleeps in the kernel while the
+* Memory Stick works) and decodes, converts and swizzles them into RAM with texconv. Finished images wait in a
+* queue until the render thread takes them with poll(). Nothing here touches the GE, so it also builds on the
+* host with -DNUCLEUS_HOST, where the worker is a std::thread and files are read with stdio.
+*/
+
+namespace nucleus
+{
+	struct loaded_image
+	{
+		unsigned int id; // returned by request
+		bool ok;
+		texconv::image_layout layout;
+		void *data; // memalign(16), layout.data_size bytes in the GE's layout, owned by whoever polls it
+		unsigned int *clut; // memalign(16), layout.clut_entries, nullptr when not paletted
+		unsigned int load_us; // worker time spent on it
+	};
+
+	struct loader_worker; // platform thread and locks
+
+	class async_loader
+	{
+	public:
+		async_loader(); // starts the worker
+		~async_loader(); // finishes the request in progress, drops the rest and stops the worker
+		// psm is a texconv::psm value, or -1 for the smallest exact paletted format. .ntx/.dxt files ignore it
+		unsigned int request(const std::string &filename, int psm, bool dither);
+		bool poll(loaded_image &image); // takes one finished image, false when none are ready
+		unsigned int getPending(void); // requested and not yet polled
+		void run(void); // worker thread body
+	private:
+		struct load_request
+		{
+			unsigned int id;
+			std::string filename;
+			int psm;
+			bool dither;
+		};
+		void load(const load_request &request, loaded_image &image);
+		loader_worker *worker;
+		std::deque<load_request> requests;
+		std::deque<loaded_image> finished;
+		unsigned int next_id, pending;
+		bool stopping;
+	};
+}
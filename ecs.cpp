@@ -0,0 +1,42 @@
+#include "ecs.h"
+
+namespace nucleus
+{
+	static unsigned int clampEntities(unsigned int max_entities)
+	{
+		return (max_entities > ECS_MAX_ENTITIES) ? ECS_MAX_ENTITIES : max_entities;
+	}
+
+	entity_world::entity_world(unsigned int max_entities) : transforms(clampEntities(max_entities)), velocities(clampEntities(max_entities)),
+		sprites(clampEntities(max_entities)), colliders(clampEntities(max_entities)), ids(clampEntities(max_entities))
+	{
+
+	}
+
+	entity entity_world::create(void)
+	{
+		return ids.allocate();
+	}
+
+	void entity_world::destroy(entity e)
+	{
+		if (!isAlive(e)) { return; }
+		transforms.remove(e.index);
+		velocities.remove(e.index);
+		sprites.remove(e.index);
+		colliders.remove(e.index);
+		ids.release(e);
+	}
+
+	void entity_world::integrate(float dt)
+	{
+		// usually fewer things move than exist, so the velocities drive the walk
+		each<velocity_component>([this, dt](unsigned short index, velocity_component &velocity) {
+			transform_component *transform = transforms.get(index);
+			if (transform != nullptr) {
+				transform->x += velocity.dx * dt;
+				transform->y += velocity.dy * dt;
+			}
+		});
+	}
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include "generational.h"
+
+#include <vector>
+
+/*
+* Entities and their components, kept as plain data in one dense array per component type so systems walk
+* memory in order instead of chasing one object per entity. Nothing in here touches the PSP SDK, so it also
+* builds on the host (tools/ecs_bench).
+*/
+
+#define ECS_MAX_ENTITIES GENERATIONAL_MAX_SLOTS
+#define ECS_NONE 0xFFFF // sparse entry of an entity without the component
+
+namespace nucleus
+{
+	class texture;
+
+	using entity = generational_handle<struct entity_tag>; // goes stale when the entity is destroyed
+
+	// position and rotation the way sprite has them: bottom left corner, radians around the sprite center
+	struct transform_component
+	{
+		float x, y;
+		float rotation;
+	};
+
+	struct velocity_component
+	{
+		float dx, dy; // world units per second
+	};
+
+	// what sprite_batch needs on top of the transform
+	struct sprite_component
+	{
+		float width, height;
+		float u0, v0, u1, v1;
+		unsigned int color;
+		texture *tex;
+	};
+
+	struct collider_component
+	{
+		float offset_x, offset_y; // bottom left corner relative to the transform's position, the box extends up like sprites
+		float width, height;
+	};
+
+	/*
+	* Dense storage for one component type. Components sit packed at the front of one array in no particular
+	* order, sparse maps an entity index to its place there and owners maps back. Add, get and remove are O(1),
+	* removing moves the last component into the hole.
+	*/
+	template <typename T>
+	class component_pool
+	{
+	public:
+		component_pool(unsigned int max_entities) : sparse(max_entities, ECS_NONE) {}
+		T *add(unsigned short index, const T &value) // replaces a component the entity already has
+		{
+			if (sparse[index] != ECS_NONE) {
+				dense[sparse[index]] = value;
+				return &dense[sparse[index]];
+			}
+			sparse[index] = dense.size();
+			dense.push_back(value);
+			owners.push_back(index);
+			return &dense.back();
+		}
+		void remove(unsigned short index)
+		{
+			unsigned short slot = sparse[index];
+			if (slot == ECS_NONE) { return; }
+			dense[slot] = dense.back();
+			owners[slot] = owners.back();
+			sparse[owners[slot]] = slot;
+			sparse[index] = ECS_NONE;
+			dense.pop_back();
+			owners.pop_back();
+		}
+		T *get(unsigned short index) {return (sparse[index] != ECS_NONE) ? &dense[sparse[index]] : nullptr;}
+		bool has(unsigned short index) const {return sparse[index] != ECS_NONE;}
+		unsigned int size(void) const {return dense.size();}
+		T *data(void) {return dense.data();}
+		const unsigned short *entities(void) const {return owners.data();} // entity index of each component in data()
+		void reserve(unsigned int count) {dense.reserve(count), owners.reserve(count);}
+	private:
+		std::vector<T> dense;
+		std::vector<unsigned short> owners;
+		std::vector<unsigned short> sparse;
+	};
+
+	class entity_world
+	{
+	public:
+		entity_world(unsigned int max_entities); // at most ECS_MAX_ENTITIES, every pool's sparse index is sized for them up front
+		entity create(void); // invalid when the world is full
+		void destroy(entity e); // removes its components too, stale ids are ignored
+		bool isAlive(entity e) const {return ids.isAlive(e);}
+		unsigned int getCount(void) const {return ids.getCount();}
+		unsigned int getCapacity(void) const {return ids.getCapacity();}
+		entity getEntity(unsigned short index) const {return ids.getHandle(index);} // for indices handed to each()
+
+		template <typename T> component_pool<T> &pool(void);
+		template <typename T> T *add(entity e, const T &value) {return isAlive(e) ? pool<T>().add(e.index, value) : nullptr;}
+		template <typename T> T *get(entity e) {return isAlive(e) ? pool<T>().get(e.index) : nullptr;}
+		template <typename T> void remove(entity e) {if (isAlive(e)) { pool<T>().remove(e.index); }}
+
+		// f(unsigned short index, T &component) for every T, in storage order
+		template <typename T, typename F> void each(F f)
+		{
+			component_pool<T> &a = pool<T>();
+			T *components = a.data();
+			const unsigned int n = a.size();
+			const unsigned short *owners = a.entities();
+			for (unsigned int i = 0; i < n; i++) {
+				f(owners[i], components[i]);
+			}
+		}
+
+		// f(unsigned short index, A &a, B &b) for entities with both, walks the smaller pool and looks the other up
+		template <typename A, typename B, typename F> void each(F f)
+		{
+			component_pool<A> &a = pool<A>();
+			component_pool<B> &b = pool<B>();
+			if (a.size() <= b.size()) {
+				each<A>([&b, &f](unsigned short index, A &first) {
+					B *second = b.get(index);
+					if (second != nullptr) { f(index, first, *second); }
+				});
+			} else {
+				each<B>([&a, &f](unsigned short index, B &second) {
+					A *first = a.get(index);
+					if (first != nullptr) { f(index, *first, second); }
+				});
+			}
+		}
+
+		void integrate(float dt); // moves every transform by its velocity
+	private:
+		component_pool<transform_component> transforms;
+		component_pool<velocity_component> velocities;
+		component_pool<sprite_component> sprites;
+		component_pool<collider_component> colliders;
+		slot_allocator<entity> ids;
+	};
+
+	template <> inline component_pool<transform_component> &entity_world::pool<transform_component>(void) {return transforms;}
+	template <> inline component_pool<velocity_component> &entity_world::pool<velocity_component>(void) {return velocities;}
+	template <> inline component_pool<sprite_component> &entity_world::pool<sprite_component>(void) {return sprites;}
+	template <> inline component_pool<collider_component> &entity_world::pool<collider_component>(void) {return colliders;}
+}
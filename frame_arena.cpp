@@ -0,0 +1,142 @@
+#include "frame_arena.h"
+#include "nucleus.h"
+
+#include <cstring>
+
+namespace nucleus
+{
+	namespace frame
+	{
+		struct ge_chunk
+		{
+			unsigned char *start;
+			unsigned int size;
+		};
+
+		static unsigned char __attribute__((aligned(16))) scratch[FRAME_SCRATCH_SIZE];
+		static unsigned int scratch_used = 0, scratch_peak = 0, scratch_failures = 0;
+		static bool scratch_failed_this_frame = false;
+
+		// chunks of the frame being built and of the one before, which the GE may still be reading
+		static ge_chunk chunks[2][FRAME_GE_MAX_CHUNKS];
+		static unsigned int n_chunks[2] = {0, 0};
+		static unsigned int current = 0;
+		static unsigned char *ge_cursor = nullptr, *ge_end = nullptr;
+		static unsigned int ge_used = 0, ge_reserved = 0, ge_chunks = 0, ge_peak = 0;
+		static unsigned int nested = 0, nested_capacity = 0;
+		static bool nested_overflow = false;
+		static bool poison = false;
+
+		static unsigned char *alignUp(unsigned char *ptr, unsigned int alignment)
+		{
+			return (unsigned char *)(((unsigned int)ptr + alignment - 1) & ~(alignment - 1));
+		}
+
+		void *allocateGe(unsigned int size, unsigned int alignment)
+		{
+			if (nested > 0) { // lives as long as the static list, not the frame
+				// sceGuGetMemory doesn't check the list's end, so refuse before it writes past it
+				if (nested_overflow || sceGuCheckList() + size + alignment - 1 + FRAME_NESTED_RESERVE > nested_capacity) {
+					nested_overflow = true;
+					return nullptr;
+				}
+				return alignUp((unsigned char *)sceGuGetMemory(size + alignment - 1), alignment);
+			}
+			unsigned char *start = alignUp(ge_cursor, alignment);
+			if (ge_cursor == nullptr || start + size > ge_end) {
+				unsigned int chunk_size = (size + alignment - 1 > FRAME_GE_CHUNK) ? size + alignment - 1 : FRAME_GE_CHUNK;
+				ge_cursor = (unsigned char *)sceGuGetMemory(chunk_size);
+				ge_end = ge_cursor + chunk_size;
+				if (n_chunks[current] < FRAME_GE_MAX_CHUNKS) {
+					chunks[current][n_chunks[current]++] = {ge_cursor, chunk_size};
+				}
+				ge_reserved += chunk_size;
+				ge_chunks++;
+				start = alignUp(ge_cursor, alignment);
+			}
+			ge_cursor = start + size;
+			ge_used += size;
+			return start;
+		}
+
+		void *allocateScratch(unsigned int size, unsigned int alignment)
+		{
+			unsigned int start = (scratch_used + alignment - 1) & ~(alignment - 1);
+			if (start + size > FRAME_SCRATCH_SIZE) {
+				scratch_failures++;
+				if (!scratch_failed_this_frame) {
+					char buff[128];
+					sprintf(buff, "Frame scratch full, %u bytes requested with %u of %u used!", size, scratch_used, FRAME_SCRATCH_SIZE);
+					writeToLog(buff);
+					scratch_failed_this_frame = true;
+				}
+				return nullptr;
+			}
+			scratch_used = start + size;
+			return &scratch[start];
+		}
+
+		void reset(unsigned int frames_in_flight)
+		{
+			scratch_peak = (scratch_used > scratch_peak) ? scratch_used : scratch_peak;
+			ge_peak = (ge_used > ge_peak) ? ge_used : ge_peak;
+			unsigned int finished = (frames_in_flight == 0) ? current : current ^ 1;
+			if (poison) {
+				memset(scratch, FRAME_POISON_BYTE, scratch_used);
+				for (unsigned int i = 0; i < n_chunks[finished]; i++) {
+					memset(chunks[finished][i].start, FRAME_POISON_BYTE, chunks[finished][i].size);
+				}
+			}
+			// the next frame records its chunks over the set the GE no longer needs, a frame in flight keeps its own
+			current = finished;
+			n_chunks[current] = 0;
+			ge_cursor = nullptr, ge_end = nullptr;
+			ge_used = 0, ge_reserved = 0, ge_chunks = 0;
+			scratch_used = 0;
+			scratch_failed_this_frame = false;
+		}
+
+		void beginNestedList(unsigned int capacity)
+		{
+			if (nested++ == 0) {
+				nested_capacity = capacity;
+				nested_overflow = false;
+			}
+		}
+
+		bool endNestedList(void)
+		{
+			if (nested > 0) {
+				nested--;
+			}
+			return !nested_overflow;
+		}
+
+		void setPoison(bool enabled)
+		{
+			poison = enabled;
+		}
+
+		frame_arena_stats getStats(void)
+		{
+			frame_arena_stats stats;
+			stats.ge_used = ge_used, stats.ge_reserved = ge_reserved, stats.ge_chunks = ge_chunks;
+			stats.ge_peak = (ge_used > ge_peak) ? ge_used : ge_peak;
+			stats.scratch_used = scratch_used;
+			stats.scratch_peak = (scratch_used > scratch_peak) ? scratch_used : scratch_peak;
+			stats.scratch_size = FRAME_SCRATCH_SIZE;
+			stats.scratch_failures = scratch_failures;
+			return stats;
+		}
+
+		void logStats(void)
+		{
+			frame_arena_stats stats = getStats();
+			char buff[256];
+			sprintf(buff, "Frame arenas: GE %u bytes in %u chunks (%u reserved, peak %u), scratch %u of %u bytes (peak %u, %u failed)",
+				stats.ge_used, stats.ge_chunks, stats.ge_reserved, stats.ge_peak, stats.scratch_used, stats.scratch_size,
+				stats.scratch_peak, stats.scratch_failures);
+			writeToLog(buff);
+		}
+	}
+}
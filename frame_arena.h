@@ -0,0 +1,43 @@
+#pragma once
+
+#define FRAME_SCRATCH_SIZE (256 * 1024) // CPU scratch memory per frame
+#define FRAME_GE_CHUNK (16 * 1024) // display list memory taken per sceGuGetMemory call
+#define FRAME_GE_MAX_CHUNKS 64 // per frame, poison mode only covers this many
+#define FRAME_NESTED_RESERVE 1024 // nested list bytes kept free for the commands that follow an allocation and sceGuFinish
+#define FRAME_POISON_BYTE 0xCD // 0xCDCDCDCD reads back as a huge negative float or an obviously bad pointer
+
+namespace nucleus
+{
+	struct frame_arena_stats
+	{
+		unsigned int ge_used, ge_reserved, ge_chunks; // this frame, reserved is what the chunks took from the list
+		unsigned int ge_peak; // most GE bytes used in any frame
+		unsigned int scratch_used, scratch_peak, scratch_size;
+		unsigned int scratch_failures; // allocations that didn't fit, since the start
+	};
+
+	/*
+	* Bump allocators for memory that only lives for one frame, both rewound by startFrame (and
+	* frame_pipeline::startFrame), nothing is freed on its own.
+	* allocateGe carves from FRAME_GE_CHUNK blocks of the display list being built (sceGuGetMemory), so vertex
+	* data costs one jump per chunk instead of one per allocation, and stays valid until the GE has drawn the frame.
+	* allocateScratch hands out CPU memory from a fixed buffer, for data the GE never sees.
+	* With poisoning on, memory is filled with FRAME_POISON_BYTE once it's given back: scratch at the next reset,
+	* display list memory once the GE is done with it, so reads through pointers kept past their frame stand out.
+	*/
+	namespace frame
+	{
+		void *allocateGe(unsigned int size, unsigned int alignment = 16); // only nullptr while recording a nested list
+		void *allocateScratch(unsigned int size, unsigned int alignment = 16); // nullptr when the frame's scratch is used up
+		// frames_in_flight is 0 when the GE has finished the frame that just ended, 1 when it may still be drawing it.
+		// Called before sceGuStart, poisoning writes over the list that's about to be reused
+		void reset(unsigned int frames_in_flight);
+		// static_list recording, allocations go straight into the recorded list and are left alone. One that would
+		// leave the list less than FRAME_NESTED_RESERVE of its capacity returns nullptr, endNestedList then returns false
+		void beginNestedList(unsigned int capacity);
+		bool endNestedList(void);
+		void setPoison(bool enabled);
+		frame_arena_stats getStats(void);
+		void logStats(void);
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdlib>
+
+/*
+* Generation checked handles and the slots behind them, for containers that hand out handles instead of pointers.
+* Freeing a slot bumps its generation, so handles to it go stale instead of pointing at whatever takes the slot
+* next. Nothing in here touches the PSP SDK.
+*/
+
+#define GENERATIONAL_MAX_SLOTS 0xFFFF // indices are 16 bit
+
+namespace nucleus
+{
+	template <typename Tag>
+	struct generational_handle // Tag only keeps handles to different kinds of slot apart
+	{
+		unsigned short index;
+		unsigned short generation; // 0 never refers to a slot
+		bool isValid(void) const {return generation != 0;}
+	};
+
+	/*
+	* Fixed number of slots, each with a generation and a used flag. The free list is popped from the back,
+	* lowest index first. Storage is allocated here or handed in by an owner that keeps everything in one block.
+	*/
+	template <typename Handle>
+	class slot_allocator
+	{
+	public:
+		slot_allocator() : generations(nullptr), free_indices(nullptr), used(nullptr), capacity(0), n_free(0), owned(false) {}
+		slot_allocator(unsigned int max_slots) : slot_allocator() {init(max_slots);}
+		~slot_allocator() {clear();}
+		slot_allocator(const slot_allocator &) = delete;
+		slot_allocator &operator=(const slot_allocator &) = delete;
+		static unsigned int getStorageBytes(unsigned int max_slots) {return max_slots * 5;}
+		// frees every slot, storage is getStorageBytes(max_slots) the caller keeps alive or nullptr to allocate it
+		void init(unsigned int max_slots, void *storage = nullptr)
+		{
+			clear();
+			capacity = (max_slots > GENERATIONAL_MAX_SLOTS) ? GENERATIONAL_MAX_SLOTS : max_slots;
+			owned = storage == nullptr;
+			unsigned char *memory = owned ? (unsigned char *)malloc(getStorageBytes(capacity)) : (unsigned char *)storage;
+			if (memory == nullptr) {
+				capacity = 0;
+				return;
+			}
+			generations = (unsigned short *)memory;
+			free_indices = generations + capacity;
+			used = (unsigned char *)(free_indices + capacity);
+			for (unsigned int i = 0; i < capacity; i++) {
+				generations[i] = 1, used[i] = 0;
+				free_indices[i] = capacity - 1 - i;
+			}
+			n_free = capacity;
+		}
+		Handle allocate(void) // invalid when every slot is taken
+		{
+			if (n_free == 0) { return {0, 0}; }
+			unsigned short index = free_indices[--n_free];
+			used[index] = 1;
+			return {index, generations[index]};
+		}
+		void release(Handle handle) // stale handles are ignored
+		{
+			if (!isAlive(handle)) { return; }
+			used[handle.index] = 0;
+			generations[handle.index] = (generations[handle.index] == 0xFFFF) ? 1 : generations[handle.index] + 1; // 0 stays invalid
+			free_indices[n_free++] = handle.index;
+		}
+		bool isAlive(Handle handle) const {return handle.index < capacity && used[handle.index] && generations[handle.index] == handle.generation;}
+		bool isUsed(unsigned short index) const {return index < capacity && used[index];}
+		Handle getHandle(unsigned short index) const {return {index, generations[index]};} // current handle of a used slot
+		unsigned int getCount(void) const {return capacity - n_free;}
+		unsigned int getCapacity(void) const {return capacity;}
+	private:
+		void clear(void)
+		{
+			if (owned) {
+				free(generations);
+			}
+			generations = nullptr, free_indices = nullptr, used = nullptr;
+			capacity = 0, n_free = 0, owned = false;
+		}
+		unsigned short *generations, *free_indices;
+		unsigned char *used;
+		unsigned int capacity, n_free;
+		bool owned;
+	};
+}
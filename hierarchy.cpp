@@ -0,0 +1,206 @@
+#include "hierarchy.h"
+
+#include <cmath>
+
+namespace nucleus
+{
+	transform_hierarchy::transform_hierarchy(unsigned int max_nodes) : ids(max_nodes)
+	{
+		slots.assign(ids.getCapacity(), {0, HIERARCHY_NONE});
+		order_dirty = false;
+	}
+
+	node_handle transform_hierarchy::add(node_handle parent, const node_transform &local_transform, entity target)
+	{
+		bool has_parent = parent.isValid();
+		if (has_parent && !isAlive(parent)) { return {0, 0}; }
+		node_handle node = ids.allocate();
+		if (!node.isValid()) { return {0, 0}; }
+		unsigned short index = node.index;
+		slot &s = slots[index];
+		s.parent = has_parent ? parent.index : HIERARCHY_NONE;
+		s.position = local.size();
+
+		// appending keeps parents ahead of their children, only a shallower node than the last needs a sort
+		unsigned short parent_position = has_parent ? slots[parent.index].position : 0;
+		unsigned short depth = has_parent ? depths[parent_position] + 1 : 0;
+		if (!depths.empty() && depth < depths.back()) {
+			order_dirty = true;
+		}
+		local.push_back(local_transform);
+		world.push_back(local_transform);
+		world_cos.push_back(1.0f);
+		world_sin.push_back(0.0f);
+		parents.push_back(has_parent ? parent_position : -1);
+		depths.push_back(depth);
+		owners.push_back(index);
+		dirty.push_back(1);
+		changed.push_back(0);
+		targets.push_back(target);
+		return node;
+	}
+
+	void transform_hierarchy::remove(node_handle node)
+	{
+		if (!isAlive(node)) { return; }
+		if (order_dirty) { // the pass below relies on parents coming first
+			sort();
+		}
+		// descendants all come after the node, and each after its own parent
+		unsigned int n = local.size(), start = slots[node.index].position;
+		std::vector<unsigned char> removing(n, 0);
+		removing[start] = 1;
+		for (unsigned int i = start + 1; i < n; i++) {
+			removing[i] = parents[i] >= 0 && removing[parents[i]];
+		}
+
+		unsigned int kept = start;
+		for (unsigned int i = start; i < n; i++) {
+			if (removing[i]) {
+				ids.release(ids.getHandle(owners[i]));
+				continue;
+			}
+			local[kept] = local[i], world[kept] = world[i];
+			world_cos[kept] = world_cos[i], world_sin[kept] = world_sin[i];
+			depths[kept] = depths[i], owners[kept] = owners[i];
+			dirty[kept] = dirty[i], changed[kept] = changed[i];
+			targets[kept] = targets[i];
+			kept++;
+		}
+		local.resize(kept), world.resize(kept);
+		world_cos.resize(kept), world_sin.resize(kept);
+		parents.resize(kept), depths.resize(kept), owners.resize(kept);
+		dirty.resize(kept), changed.resize(kept);
+		targets.resize(kept);
+		rebuildLinks();
+	}
+
+	bool transform_hierarchy::setParent(node_handle node, node_handle parent)
+	{
+		if (!isAlive(node)) { return false; }
+		if (parent.isValid()) {
+			if (!isAlive(parent)) { return false; }
+			for (unsigned short s = parent.index; s != HIERARCHY_NONE; s = slots[s].parent) {
+				if (s == node.index) { return false; }
+			}
+		}
+		slots[node.index].parent = parent.isValid() ? parent.index : HIERARCHY_NONE;
+		dirty[slots[node.index].position] = 1;
+		order_dirty = true;
+		return true;
+	}
+
+	void transform_hierarchy::setLocal(node_handle node, const node_transform &local_transform)
+	{
+		if (!isAlive(node)) { return; }
+		unsigned short position = slots[node.index].position;
+		local[position] = local_transform;
+		dirty[position] = 1;
+	}
+
+	const node_transform *transform_hierarchy::getLocal(node_handle node) const
+	{
+		return isAlive(node) ? &local[slots[node.index].position] : nullptr;
+	}
+
+	const node_transform *transform_hierarchy::getWorld(node_handle node) const
+	{
+		return isAlive(node) ? &world[slots[node.index].position] : nullptr;
+	}
+
+	template <typename T>
+	static void permute(std::vector<T> &values, const std::vector<unsigned int> &order)
+	{
+		std::vector<T> sorted(values.size());
+		for (unsigned int i = 0; i < order.size(); i++) {
+			sorted[i] = values[order[i]];
+		}
+		values.swap(sorted);
+	}
+
+	void transform_hierarchy::sort(void)
+	{
+		// depths from the slot links, setParent has made the stored ones and the packed order unreliable
+		unsigned int n = local.size(), max_depth = 0;
+		for (unsigned int i = 0; i < n; i++) {
+			unsigned short depth = 0;
+			for (unsigned short s = slots[owners[i]].parent; s != HIERARCHY_NONE; s = slots[s].parent) {
+				depth++;
+			}
+			depths[i] = depth;
+			max_depth = (depth > max_depth) ? depth : max_depth;
+		}
+
+		// counting sort, stable so siblings keep their order
+		std::vector<unsigned int> starts(max_depth + 2, 0), order(n);
+		for (unsigned int i = 0; i < n; i++) {
+			starts[depths[i] + 1]++;
+		}
+		for (unsigned int d = 1; d <= max_depth + 1; d++) {
+			starts[d] += starts[d - 1];
+		}
+		for (unsigned int i = 0; i < n; i++) {
+			order[starts[depths[i]]++] = i;
+		}
+		permute(local, order), permute(world, order);
+		permute(world_cos, order), permute(world_sin, order);
+		permute(depths, order), permute(owners, order);
+		permute(dirty, order), permute(changed, order);
+		permute(targets, order);
+		rebuildLinks();
+		order_dirty = false;
+	}
+
+	void transform_hierarchy::rebuildLinks(void)
+	{
+		unsigned int n = local.size();
+		for (unsigned int i = 0; i < n; i++) {
+			slots[owners[i]].position = i;
+		}
+		parents.resize(n);
+		for (unsigned int i = 0; i < n; i++) {
+			unsigned short parent = slots[owners[i]].parent;
+			parents[i] = (parent == HIERARCHY_NONE) ? -1 : slots[parent].position;
+		}
+	}
+
+	unsigned int transform_hierarchy::update(void)
+	{
+		if (order_dirty) {
+			sort();
+		}
+		unsigned int n = local.size(), recomputed = 0;
+		for (unsigned int i = 0; i < n; i++) {
+			int parent = parents[i];
+			changed[i] = dirty[i] || (parent >= 0 && changed[parent]);
+			if (!changed[i]) { continue; }
+			if (parent < 0) {
+				world[i] = local[i];
+			} else {
+				const node_transform &p = world[parent];
+				float c = world_cos[parent], s = world_sin[parent];
+				world[i].x = p.x + local[i].x * c - local[i].y * s;
+				world[i].y = p.y + local[i].x * s + local[i].y * c;
+				world[i].rotation = p.rotation + local[i].rotation;
+			}
+			world_cos[i] = cosf(world[i].rotation);
+			world_sin[i] = sinf(world[i].rotation);
+			dirty[i] = 0;
+			recomputed++;
+		}
+		return recomputed;
+	}
+
+	void transform_hierarchy::apply(entity_world &entities)
+	{
+		unsigned int n = local.size();
+		for (unsigned int i = 0; i < n; i++) {
+			if (!changed[i] || !targets[i].isValid()) { continue; }
+			transform_component *transform = entities.get<transform_component>(targets[i]);
+			if (transform != nullptr) {
+				transform->x = world[i].x, transform->y = world[i].y;
+				transform->rotation = world[i].rotation;
+			}
+		}
+	}
+}
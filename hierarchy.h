@@ -0,0 +1,59 @@
+#pragma once
+#include "ecs.h"
+
+#include <vector>
+
+#define HIERARCHY_NONE 0xFFFF // parent slot of a root
+
+namespace nucleus
+{
+	using node_handle = generational_handle<struct node_tag>; // transform_hierarchy slot
+
+	struct node_transform
+	{
+		float x, y; // local: in the parent's space, world: same convention as transform_component
+		float rotation; // radians
+	};
+
+	/*
+	* Parent/child transforms for things that hang off each other (a held item, the links of a rope). Nodes are
+	* kept in packed arrays sorted by depth, so every parent comes before its children and update() works out
+	* world transforms in one pass, skipping every node whose own transform and ancestors haven't changed.
+	* Results go straight into entity_world transform_components (apply), which sprite_batch draws from without
+	* touching the Gum matrix stack. Nothing in here touches the PSP SDK.
+	*/
+	class transform_hierarchy
+	{
+	public:
+		transform_hierarchy(unsigned int max_nodes); // at most 65535
+		// an invalid parent makes a root, target (optional) is the entity apply() writes the world transform to
+		node_handle add(node_handle parent, const node_transform &local, entity target = {0, 0});
+		void remove(node_handle node); // removes everything under it as well
+		bool setParent(node_handle node, node_handle parent); // keeps the local transform, false if parent is the node or below it
+		void setLocal(node_handle node, const node_transform &local);
+		bool isAlive(node_handle node) const {return ids.isAlive(node);}
+		const node_transform *getLocal(node_handle node) const;
+		const node_transform *getWorld(node_handle node) const; // as of the last update
+		unsigned int update(void); // returns how many world transforms were recomputed
+		void apply(entity_world &entities); // targets of nodes the last update recomputed
+		unsigned int getCount(void) const {return local.size();}
+	private:
+		struct slot
+		{
+			unsigned short position; // in the packed arrays
+			unsigned short parent; // slot, HIERARCHY_NONE for roots
+		};
+		void sort(void); // back into depth order after setParent
+		void rebuildLinks(void); // positions and parent positions after the packed arrays moved
+		// packed, depth sorted
+		std::vector<node_transform> local, world;
+		std::vector<float> world_cos, world_sin; // children of a node all rotate by the same angle
+		std::vector<int> parents; // position of the parent, -1 for roots
+		std::vector<unsigned short> depths, owners; // owners maps a position back to its slot
+		std::vector<unsigned char> dirty, changed;
+		std::vector<entity> targets;
+		std::vector<slot> slots;
+		slot_allocator<node_handle> ids;
+		bool order_dirty;
+	};
+}
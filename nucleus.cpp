@@ -1,25 +1,60 @@
 #include "nucleus.h"
+#include "async_loader.h"
 #include "callbacks.h"
 
+#include <algorithm>
+#include <cmath>
+#include <strings.h>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 namespace nucleus
 {
+	static unsigned int frame_number = 0; // advanced by startFrame, lets per frame counters reset lazily
+	static bool recording_static_list = false; // recorded binds must not point at VRAM the cache can reuse
+	static unsigned int live_textures = 0, live_texture_bytes = 0; // textures owning memory, checked by termGraphics
+
+	// texture_manager textures removed while a list still in flight may sample them, freed once it has been synced
+	struct retired_texture
+	{
+		texture *tex; // moved out of its slot, owns the pixels and CLUT
+		void *vram_copy; // texture_manager's paged in copy, nullptr if it wasn't resident
+		unsigned int frame; // frame_number it was retired in
+	};
+	static std::vector<retired_texture> retired_textures;
+
+	// frames_in_flight as for frame::reset, everything goes when the GE is idle for good (termGraphics)
+	static void releaseRetired(unsigned int frames_in_flight, bool everything = false)
+	{
+		size_t kept = 0;
+		for (retired_texture &r : retired_textures) {
+			if (everything || r.frame + frames_in_flight < frame_number) {
+				delete r.tex;
+				vram::release(r.vram_copy);
+			} else {
+				retired_textures[kept++] = r;
+			}
+		}
+		retired_textures.resize(kept);
+	}
+
+	using texconv::bitsPerPixel;
+	static_assert(texconv::psm::RGBA8888 == GU_PSM_8888 && texconv::psm::T4 == GU_PSM_T4 && texconv::psm::DXT5 == GU_PSM_DXT5, "texconv psm values must match the GE");
+
 	// data types
 
 	mesh::mesh(unsigned int n_vertices, unsigned int index_count)
 	{
 		n_mesh_vertices = n_vertices;
-		vertices = (vertex*)memalign(16, sizeof(vertex) * n_vertices);
-		vertex_indices = (unsigned short*)memalign(16, sizeof(unsigned short) * index_count);
+		vertices = (vertex*)memalign(16, sizeof(vertex) * n_vertices + sizeof(unsigned short) * index_count);
+		vertex_indices = (unsigned short*)(vertices + n_vertices); // vertices are 16 bytes, so the indices stay aligned
 		n_indices = index_count;
 	}
 
 	mesh::~mesh()
 	{
 		free(vertices);
-		free(vertex_indices);
 	}
 
 	void mesh::insertVertex(vertex v, unsigned int vn) 
@@ -51,16 +86,31 @@ namespace nucleus
 		quad_pos.x = pos->x, quad_pos.y = pos->y, quad_pos.z = pos->z;
 	}
 
-	texture_quad::texture_quad(float twidth, float theight, ScePspFVector3 *pos, unsigned int color)
+	template <typename T>
+	void quad<T>::setUV(const uv_rect &uv)
+	{
+		// vertex order matches the constructors: top left, top right, bottom right, bottom left
+		vertices[0].u = uv.u0, vertices[0].v = uv.v0;
+		vertices[1].u = uv.u1, vertices[1].v = uv.v0;
+		vertices[2].u = uv.u1, vertices[2].v = uv.v1;
+		vertices[3].u = uv.u0, vertices[3].v = uv.v1;
+		sceKernelDcacheWritebackRange(vertices, sizeof(vertices));
+	}
+
+	template class quad<tex_vertex>;
+	template class quad<tcnp_vertex>;
+
+	texture_quad::texture_quad(float twidth, float theight, ScePspFVector3 *pos, unsigned int color, const uv_rect *uv)
 	{
 		width = twidth, height = theight;
 		quad_pos.x = pos->x, quad_pos.y = pos->y;
 		quad_pos.z = 0.0f;
+		uv_rect r = (uv != nullptr) ? *uv : uv_rect{0.0f, 0.0f, 1.0f, 1.0f};
 		
-		tex_vertex t0 = {0.0f, 0.0f, color, 0.0f, -height, 0.0f};
-		tex_vertex t1 = {1.0f, 0.0f, color, width, -height, 0.0f};
-		tex_vertex t2 = {1.0f, 1.0f, color, width, 0.0f, 0.0f};
-		tex_vertex t3 = {0.0f, 1.0f, color, 0.0f, 0.0f, 0.0f};
+		tex_vertex t0 = {r.u0, r.v0, color, 0.0f, -height, 0.0f};
+		tex_vertex t1 = {r.u1, r.v0, color, width, -height, 0.0f};
+		tex_vertex t2 = {r.u1, r.v1, color, width, 0.0f, 0.0f};
+		tex_vertex t3 = {r.u0, r.v1, color, 0.0f, 0.0f, 0.0f};
 
 		vertices[0] = t0, vertices[1] = t1, vertices[2] = t2, vertices[3] = t3;
 		vertex_indices[0] = 0, vertex_indices[1] = 1, vertex_indices[2] = 2, vertex_indices[3] = 0, vertex_indices[4] = 2, vertex_indices[5] = 3;
@@ -82,16 +132,17 @@ namespace nucleus
 		sceGumDrawArray(GU_TRIANGLES, PSP_TEXTURE_VERTICES, N_QUAD_INDICES, vertex_indices, vertices);
 	}
 
-	lit_texture_quad::lit_texture_quad(float twidth, float theight, ScePspFVector3 *pos, unsigned int color)
+	lit_texture_quad::lit_texture_quad(float twidth, float theight, ScePspFVector3 *pos, unsigned int color, const uv_rect *uv)
 	{
 		width = twidth, height = theight;
 		quad_pos.x = pos->x, quad_pos.y = pos->y;
 		quad_pos.z = 0.0f;
+		uv_rect r = (uv != nullptr) ? *uv : uv_rect{0.0f, 0.0f, 1.0f, 1.0f};
 
-		tcnp_vertex v0 = {0.0f, 0.0f, color, 0.0f, 0.0f, 1.0f, 0.0f, -height, 0.0f};
-		tcnp_vertex v1 = {1.0f, 0.0f, color, 0.0f, 0.0f, 1.0f, width, -height, 0.0f};
-		tcnp_vertex v2 = {1.0f, 1.0f, color, 0.0f, 0.0f, 1.0f, width, 0.0f, 0.0f};
-		tcnp_vertex v3 = {0.0f, 1.0f, color, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f};
+		tcnp_vertex v0 = {r.u0, r.v0, color, 0.0f, 0.0f, 1.0f, 0.0f, -height, 0.0f};
+		tcnp_vertex v1 = {r.u1, r.v0, color, 0.0f, 0.0f, 1.0f, width, -height, 0.0f};
+		tcnp_vertex v2 = {r.u1, r.v1, color, 0.0f, 0.0f, 1.0f, width, 0.0f, 0.0f};
+		tcnp_vertex v3 = {r.u0, r.v1, color, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f};
 
 		vertices[0] = v0, vertices[1] = v1, vertices[2] = v2, vertices[3] = v3;
 		vertex_indices[0] = 0, vertex_indices[1] = 1, vertex_indices[2] = 2, vertex_indices[3] = 0, vertex_indices[4] = 2, vertex_indices[5] = 3;
@@ -110,8 +161,63 @@ namespace nucleus
 		sceGumDrawArray(GU_TRIANGLES, PSP_TEXTURE_NORMAL_VERTICES, N_QUAD_INDICES, vertex_indices, vertices);
 	}
 
-	void texture::loadTexture(const char *filename, const int vram) // use GU_TRUE for vram parameter
+	static int formatPsm(texture_format format)
 	{
+		switch (format) {
+			case texture_format::RGB5650: return GU_PSM_5650;
+			case texture_format::RGBA5551: return GU_PSM_5551;
+			case texture_format::RGBA4444: return GU_PSM_4444;
+			case texture_format::T8: return GU_PSM_T8;
+			case texture_format::T4: return GU_PSM_T4;
+			case texture_format::DXT1: return GU_PSM_DXT1;
+			case texture_format::DXT3: return GU_PSM_DXT3;
+			case texture_format::DXT5: return GU_PSM_DXT5;
+			default: return GU_PSM_8888;
+		}
+	}
+
+	static const char *psmName(int psm)
+	{
+		switch (psm) {
+			case GU_PSM_5650: return "5650";
+			case GU_PSM_5551: return "5551";
+			case GU_PSM_4444: return "4444";
+			case GU_PSM_T8: return "T8";
+			case GU_PSM_T4: return "T4";
+			case GU_PSM_DXT1: return "DXT1";
+			case GU_PSM_DXT3: return "DXT3";
+			case GU_PSM_DXT5: return "DXT5";
+		}
+		return "8888";
+	}
+
+	static bool isCompressed(int psm)
+	{
+		return psm == GU_PSM_DXT1 || psm == GU_PSM_DXT3 || psm == GU_PSM_DXT5;
+	}
+
+	static texconv::dxt psmDxt(int psm)
+	{
+		return (psm == GU_PSM_DXT1) ? texconv::dxt::DXT1 : (psm == GU_PSM_DXT3) ? texconv::dxt::DXT3 : texconv::dxt::DXT5;
+	}
+
+	static bool hasExtension(const char *filename, const char *extension)
+	{
+		size_t length = strlen(filename), extension_length = strlen(extension);
+		return length >= extension_length && strcasecmp(filename + length - extension_length, extension) == 0;
+	}
+
+	void texture::loadTexture(const char *filename, const int vram, texture_format format, bool dither, bool mipmaps) // use GU_TRUE for vram parameter
+	{
+		unloadTexture();
+		unsigned int load_start = sceKernelGetSystemTimeLow();
+		if (hasExtension(filename, ".ntx") || hasExtension(filename, ".dxt")) {
+			loadBaked(filename, vram);
+			if (texture_data != nullptr) {
+				logLoad(filename, load_start);
+			}
+			return;
+		}
 		stbi_set_flip_vertically_on_load(GU_FALSE);
 		unsigned char *data = stbi_load(filename, &width, &height, &nr_channels, STBI_rgb_alpha);
 		pspDebugScreenSetXY(0, 0);
@@ -121,43 +227,255 @@ namespace nucleus
 			return;
 		} 
 
-		pixel_width = pow2(width);
-		pixel_height = pow2(height);
-
-		void *data_buffer = (unsigned int *)memalign(16, pixel_width * pixel_height * 4);
-
-		copy_texture_data(data_buffer, data);
+		int format_psm = (format == texture_format::INDEXED) ? texconv::smallestIndexed((unsigned int *)data, width, height) : formatPsm(format);
+		texconv::image_layout layout = texconv::layoutFor(format_psm, width, height, mipmaps);
+		if (mipmaps && layout.mip_levels == 1) {
+			writeToLog("Mipmaps need an 8888 or 16 bit texture format, loading a single level.");
+		}
+		setLayout(layout);
+		void *pixels = allocatePixels(vram);
+		if (layout.clut_entries > 0) {
+			clut = (unsigned int *)memalign(16, layout.clut_entries * 4);
+			clut_entries = layout.clut_entries;
+		}
+		texture_data = pixels;
+		trackAlive();
+		if (pixels == nullptr || (clut_entries > 0 && clut == nullptr)) {
+			stbi_image_free(data);
+			writeToLog("Unable to allocate texture!");
+			unloadTexture();
+			return;
+		}
 
+		// padded, converted and swizzled (or DXT encoded) straight into where it's sampled from
+		texconv::convertImage((const unsigned int *)data, layout, dither, pixels, clut);
 		stbi_image_free(data);
-		
-		unsigned int *swizzled_pixels = nullptr;
+		logLoad(filename, load_start);
+		sceKernelDcacheWritebackInvalidateAll();
+	}
+
+	void *texture::allocatePixels(const int vram)
+	{
+		void *pixels = nullptr;
+		in_vram = false;
 		if (vram) 
 		{
-			swizzled_pixels = (unsigned int *)getStaticVramTexture(pixel_width, pixel_height, GU_PSM_8888);
-			writeToLog("Texture loaded into ram.\n");
-		} else
+			pixels = vram::allocate(getSizeBytes()); // getStaticVramTexture would only count level 0
+			in_vram = pixels != nullptr;
+			if (!in_vram) {
+				writeToLog("VRAM full, texture loaded into ram instead.");
+			}
+		}
+		if (pixels == nullptr)
 		{
-			swizzled_pixels = (unsigned int *)memalign(16, pixel_height * pixel_width * 4);
+			pixels = memalign(16, getSizeBytes());
 		}
+		return pixels;
+	}
 
-		swizzle_fast((u8*)swizzled_pixels, (const u8*) data_buffer, pixel_width * 4, pixel_height);
-
-		free(data_buffer);
-		texture_data = swizzled_pixels;
+	void texture::logLoad(const char *filename, unsigned int load_start)
+	{
 		char buff[256];
-		sprintf(buff, "Texture allocated at: %p", texture_data);
+		sprintf(buff, "Texture %s allocated at: %p, %s %dx%d, %u levels, %u bytes (%u as 8888), loaded in %.2f ms", filename, texture_data,
+			psmName(psm), pixel_width, pixel_height, mip_levels,
+			getSizeBytes() + clut_entries * 4, pow2(width) * pow2(height) * 4, (sceKernelGetSystemTimeLow() - load_start) / 1000.0f);
 		writeToLog(buff);
+	}
+
+	void texture::loadBaked(const char *filename, const int vram)
+	{
+		texture_data = nullptr;
+		int fd = sceIoOpen(filename, PSP_O_RDONLY, 0777);
+		if (fd < 0) {
+			writeToLog("Unable to load texture!");
+			return;
+		}
+		// a small .dxt can be shorter than an .ntx header, readHeader only needs what the format uses
+		unsigned char header[sizeof(texconv::ntx_header)];
+		int header_bytes = sceIoRead(fd, header, sizeof(header));
+		texconv::image_layout layout;
+		unsigned int header_size;
+		if (header_bytes <= 0 || !texconv::readHeader(header, header_bytes, layout, header_size)) {
+			sceIoClose(fd);
+			writeToLog("Not a nucleus texture file!");
+			return;
+		}
+		setLayout(layout);
+		sceIoLseek32(fd, header_size, PSP_SEEK_SET);
+		unsigned int data_size = layout.data_size, n_clut = layout.clut_entries;
+
+		// the data is already padded, converted and swizzled, so it's read once straight to where it's sampled from
+		void *pixels = allocatePixels(vram);
+		if (n_clut > 0) {
+			clut = (unsigned int *)memalign(16, n_clut * 4);
+			clut_entries = n_clut;
+		}
+		bool complete = pixels != nullptr && sceIoRead(fd, pixels, data_size) == (int)data_size;
+		if (complete && n_clut > 0) {
+			complete = clut != nullptr && sceIoRead(fd, clut, n_clut * 4) == (int)(n_clut * 4);
+		}
+		sceIoClose(fd);
+		texture_data = pixels;
+		trackAlive();
+		if (!complete) {
+			writeToLog("Truncated texture file!");
+			unloadTexture();
+			return;
+		}
 		sceKernelDcacheWritebackInvalidateAll();
 	}
 
-	texture::texture(const char *filename, const int vram)
+	void texture::setLayout(const texconv::image_layout &layout)
+	{
+		psm = layout.psm;
+		width = layout.width, height = layout.height;
+		pixel_width = layout.pixel_width, pixel_height = layout.pixel_height;
+		mip_levels = layout.mip_levels;
+		nr_channels = 4;
+	}
+
+	void texture::adoptImage(const texconv::image_layout &layout, void *data, unsigned int *image_clut)
 	{
-		loadTexture(filename, vram);
+		setLayout(layout);
+		texture_data = data;
+		clut = image_clut, clut_entries = layout.clut_entries;
+		in_vram = false;
+		pending = false;
+		trackAlive();
+	}
+
+	void texture::trackAlive(void)
+	{
+		if (texture_data == nullptr) { return; }
+		owned_bytes = getSizeBytes() + clut_entries * 4;
+		live_textures++;
+		live_texture_bytes += owned_bytes;
+	}
+
+	void texture::borrow(const texture &other)
+	{
+		unloadTexture();
+		texture_data = other.texture_data;
+		psm = other.psm, mip_levels = other.mip_levels;
+		width = other.width, height = other.height;
+		pixel_width = other.pixel_width, pixel_height = other.pixel_height;
+		pending = true;
+	}
+
+	unsigned int texture::getLiveCount(void)
+	{
+		return live_textures;
+	}
+
+	unsigned int texture::getLiveBytes(void)
+	{
+		return live_texture_bytes;
+	}
+
+	unsigned int texture::getLevelSize(unsigned int level)
+	{
+		return (pixel_width >> level) * (pixel_height >> level) * bitsPerPixel(psm) / 8;
+	}
+
+	unsigned int texture::getSizeBytes(void)
+	{
+		unsigned int size = 0;
+		for (unsigned int level = 0; level < mip_levels; level++) {
+			size += getLevelSize(level);
+		}
+		return size;
+	}
+
+	texture::texture()
+	{
+		texture_id = 0;
+		texture_data = nullptr;
+		in_vram = false, vram_tracked = false, pending = false;
+		owned_bytes = 0;
+		vram_data = nullptr;
+		clut = nullptr, clut_entries = 0;
+		psm = GU_PSM_8888;
+		mip_levels = 1;
+		width = 0, height = 0, pixel_width = 0, pixel_height = 0, nr_channels = 4;
+		cache = nullptr;
+		last_bind = 0, last_frame = 0;
+	}
+
+	texture::texture(const char *filename, const int vram, texture_format format, bool dither, bool mipmaps) : texture()
+	{
+		loadTexture(filename, vram, format, dither, mipmaps);
+	}
+
+	texture::texture(texture &&other) : texture()
+	{
+		*this = std::move(other);
+	}
+
+	texture &texture::operator=(texture &&other)
+	{
+		if (this == &other) { return *this; }
+		unloadTexture();
+		if (other.cache != nullptr) {
+			other.cache->evict(other); // the cache's resident list points at the texture, not its data
+		}
+		texture_data = other.texture_data, vram_data = nullptr;
+		clut = other.clut, clut_entries = other.clut_entries;
+		cache = other.cache;
+		last_bind = other.last_bind, last_frame = other.last_frame;
+		in_vram = other.in_vram, vram_tracked = other.vram_tracked, pending = other.pending;
+		texture_id = other.texture_id;
+		width = other.width, height = other.height, pixel_width = other.pixel_width, pixel_height = other.pixel_height;
+		nr_channels = other.nr_channels, psm = other.psm, mip_levels = other.mip_levels;
+		owned_bytes = other.owned_bytes;
+		if (in_vram && vram_tracked) {
+			vram::setOwner(texture_data, &texture_data); // compact has to patch the new address
+		}
+		other.texture_data = nullptr, other.clut = nullptr, other.clut_entries = 0;
+		other.cache = nullptr;
+		other.in_vram = false, other.vram_tracked = false, other.pending = false;
+		other.texture_id = 0, other.owned_bytes = 0;
+		return *this;
 	}
 
 	texture::~texture()
 	{
+		unloadTexture();
+	}
+
+	void texture::trackVramOwner(void)
+	{
+		if (in_vram) {
+			vram::setOwner(texture_data, &texture_data);
+			vram_tracked = true;
+		}
+	}
 
+	void texture::unloadTexture(void)
+	{
+		if (cache != nullptr) {
+			cache->evict(*this);
+		}
+		if (pending) { // the placeholder belongs to the manager
+			texture_data = nullptr;
+			pending = false;
+			return;
+		}
+		if (texture_data != nullptr) {
+			live_textures--;
+			live_texture_bytes -= owned_bytes;
+			owned_bytes = 0;
+		}
+		free(clut);
+		clut = nullptr, clut_entries = 0;
+		if (texture_data == nullptr) { return; }
+		if (in_vram) {
+			vram::release(texture_data);
+		} else {
+			free(texture_data);
+		}
+		texture_data = nullptr;
+		in_vram = false, vram_tracked = false;
+		state::invalidate(); // the next texture or palette allocated at these addresses must not look already bound
 	}
 
 	void texture::bindTexture(void)
@@ -168,43 +486,31 @@ namespace nucleus
 		} else {
 			//writeToLog("Texture bound!");
 		}
+		const void *data = texture_data;
+		if (cache != nullptr && !recording_static_list) {
+			data = cache->makeResident(*this);
+		}
 			
-		sceGuTexMode(GU_PSM_8888, 0, 0, 1);
-    	sceGuTexFunc(GU_TFX_MODULATE, GU_TCC_RGBA);
-    	sceGuTexFilter(GU_NEAREST, GU_NEAREST);
-    	sceGuTexWrap(GU_REPEAT, GU_REPEAT);
-		sceGuTexImage(0, pixel_width, pixel_height, pixel_width, texture_data);
-	}
-
-	void texture::swizzle_fast(u8 *out, const u8 *in, const unsigned int width, const unsigned int height) // from Iridescentrose
-	{
-		unsigned int blockx, blocky;
-    	unsigned int j;
-
-    	unsigned int width_blocks = (width / 16);
-    	unsigned int height_blocks = (height / 8);
-
-    	unsigned int src_pitch = (width - 16) / 4;
-    	unsigned int src_row = width * 8;
-
-    	const u8 *ysrc = in;
-    	u32 *dst = (u32 *)out;
-
-    	for (blocky = 0; blocky < height_blocks; ++blocky) {
-        	const u8 *xsrc = ysrc;
-        	for (blockx = 0; blockx < width_blocks; ++blockx) {
-            	const u32 *src = (u32 *)xsrc;
-            	for (j = 0; j < 8; ++j) {
-                	*(dst++) = *(src++);
-                	*(dst++) = *(src++);
-                	*(dst++) = *(src++);
-                	*(dst++) = *(src++);
-                	src += src_pitch;
-            	}
-            	xsrc += 16;
-        	}
-        	ysrc += src_row;
-    	}
+		if (clut != nullptr) {
+			state::clutMode(GU_PSM_8888, 0, 0xFF, 0);
+			state::clutLoad(clut_entries / 8, clut);
+		}
+		state::texMode(psm, mip_levels - 1, 0, isCompressed(psm) ? 0 : 1);
+		state::texFunc(GU_TFX_MODULATE, GU_TCC_RGBA);
+		if (mip_levels > 1) {
+			// the GE picks the level from the uv slope of each primitive, bilinear inside it keeps minified texels stable
+			state::texLevelMode(GU_TEXTURE_AUTO, 0.0f);
+			state::texFilter(GU_LINEAR_MIPMAP_NEAREST, GU_NEAREST);
+		} else {
+			state::texFilter(GU_NEAREST, GU_NEAREST);
+		}
+		state::texWrap(GU_REPEAT, GU_REPEAT);
+		const unsigned char *level_data = (const unsigned char *)data;
+		for (unsigned int level = 0; level < mip_levels; level++) {
+			int level_width = pixel_width >> level, level_height = pixel_height >> level;
+			state::texImage(level, level_width, level_height, level_width, level_data);
+			level_data += getLevelSize(level);
+		}
 	}
 
 	unsigned int texture::pow2(const unsigned int val)
@@ -216,28 +522,763 @@ namespace nucleus
     	return poweroftwo;
 	}
 
-	void texture::copy_texture_data(void *dest, const void *src)
+	sprite_batch::sprite_batch()
 	{
-		for (int y = 0; y < height; y++) {
-        	for (int x = 0; x < width; x++) {
-        		((unsigned int*)dest)[x + y * pixel_width] = ((unsigned int *)src)[x + y * width];
-       		}
-    	}
+		n_sprites = 0;
+		current_texture = nullptr;
+		current_mode = primitive_mode::TRIANGLES;
+		view_x = 0.0f, view_y = 0.0f;
+		view_zoom = 1.0f;
+		view_rect = {0.0f, 0.0f, 0.0f, 0.0f};
+		culling = false;
+		draw_calls = 0, sprite_count = 0, vertex_bytes = 0;
+	}
+
+	void sprite_batch::begin(camera2D *camera)
+	{
+		n_sprites = 0;
+		current_texture = nullptr;
+		current_mode = primitive_mode::TRIANGLES;
+		if (camera != nullptr) {
+			ScePspFVector3 camera_pos = camera->getCameraPosition();
+			view_x = camera_pos.x, view_y = camera_pos.y;
+			view_zoom = camera->getZoom();
+			view_rect = camera->getVisibleRect();
+			culling = true;
+		} else {
+			view_x = 0.0f, view_y = 0.0f;
+			view_zoom = 1.0f;
+			culling = false; // no view to test against, e.g. while recording a static_list
+		}
+		draw_calls = 0, sprite_count = 0, vertex_bytes = 0;
+	}
+
+	void sprite_batch::draw(const sprite &s, primitive_mode mode)
+	{
+		if (culling) {
+			rect bounds = {s.x, s.y - s.height, s.width, s.height};
+			if (s.rotation != 0.0f) { // grow to the square that contains the sprite at any angle
+				float radius = 0.5f * sqrtf(s.width * s.width + s.height * s.height);
+				bounds = {s.x + 0.5f * s.width - radius, s.y - 0.5f * s.height - radius, 2.0f * radius, 2.0f * radius};
+			}
+			if (!cull::isVisible(view_rect, bounds)) { return; }
+		}
+		if (s.sprite_texture != current_texture || mode != current_mode) { // state change ends the current run
+			flush();
+			current_texture = s.sprite_texture;
+			current_mode = mode;
+		}
+		if (n_sprites >= SPRITE_BATCH_CAPACITY) {
+			flush();
+		}
+		sprites[n_sprites++] = s;
+	}
+
+	void sprite_batch::flush(void)
+	{
+		if (n_sprites == 0) { return; }
+
+		if (current_texture != nullptr) {
+			current_texture->bindTexture();
+		}
+		if (current_mode == primitive_mode::SPRITES) {
+			writeSprites();
+		} else {
+			writeTriangles();
+		}
+
+		draw_calls++;
+		sprite_count += n_sprites;
+		n_sprites = 0;
+	}
+
+	void sprite_batch::writeTriangles(void)
+	{
+		// vertices live in the display list, so they stay valid until the Gu is done with this frame
+		unsigned int n_vertices = n_sprites * N_SPRITE_VERTICES;
+		tex_vertex *vertices = (tex_vertex *)frame::allocateGe(n_vertices * sizeof(tex_vertex));
+		if (vertices == nullptr) { return; } // static_list full, it reports the overflow
+		tex_vertex *v = vertices;
+		for (unsigned int i = 0; i < n_sprites; i++) {
+			const sprite &s = sprites[i];
+			float left = s.x, right = s.x + s.width;
+			float top = s.y - s.height, bottom = s.y;
+			v[0] = {s.u0, s.v0, s.color, left, top, 0.0f};
+			v[1] = {s.u1, s.v0, s.color, right, top, 0.0f};
+			v[2] = {s.u1, s.v1, s.color, right, bottom, 0.0f};
+			v[5] = {s.u0, s.v1, s.color, left, bottom, 0.0f};
+			if (s.rotation != 0.0f) {
+				float cx = s.x + s.width * 0.5f, cy = s.y - s.height * 0.5f;
+				float c = cosf(s.rotation), sn = sinf(s.rotation);
+				for (int corner : {0, 1, 2, 5}) {
+					float dx = v[corner].x - cx, dy = v[corner].y - cy;
+					v[corner].x = cx + dx * c - dy * sn;
+					v[corner].y = cy + dx * sn + dy * c;
+				}
+			}
+			v[3] = v[0];
+			v[4] = v[2];
+			v += N_SPRITE_VERTICES;
+		}
+
+		// sprites are already in world space
+		sceGumMatrixMode(GU_MODEL);
+		sceGumLoadIdentity();
+		sceGumDrawArray(GU_TRIANGLES, PSP_BATCH_VERTICES, n_vertices, nullptr, vertices);
+		vertex_bytes += n_vertices * sizeof(tex_vertex);
+	}
+
+	void sprite_batch::writeSprites(void)
+	{
+		// GU_TRANSFORM_2D skips the matrices, so the camera offset is applied here and uvs are scaled to texels
+		float tex_w = 0.0f, tex_h = 0.0f;
+		if (current_texture != nullptr) {
+			tex_w = current_texture->getPixelWidth(), tex_h = current_texture->getPixelHeight();
+		}
+		unsigned int n_vertices = n_sprites * N_SPRITE_CORNERS;
+		sprite_vertex *vertices = (sprite_vertex *)frame::allocateGe(n_vertices * sizeof(sprite_vertex));
+		if (vertices == nullptr) { return; }
+		sprite_vertex *v = vertices;
+		for (unsigned int i = 0; i < n_sprites; i++) {
+			const sprite &s = sprites[i];
+			float left = floorf((s.x - view_x) * view_zoom + 0.5f), top = floorf((s.y - s.height - view_y) * view_zoom + 0.5f);
+			float right = floorf((s.x + s.width - view_x) * view_zoom + 0.5f), bottom = floorf((s.y - view_y) * view_zoom + 0.5f);
+			v[0] = {(unsigned short)(s.u0 * tex_w), (unsigned short)(s.v0 * tex_h), s.color, (short)left, (short)top, 0};
+			v[1] = {(unsigned short)(s.u1 * tex_w), (unsigned short)(s.v1 * tex_h), s.color, (short)right, (short)bottom, 0};
+			v += N_SPRITE_CORNERS;
+		}
+
+		sceGuDrawArray(GU_SPRITES, PSP_SPRITE_VERTICES, n_vertices, nullptr, vertices);
+		vertex_bytes += n_vertices * sizeof(sprite_vertex);
+	}
+
+	void sprite_batch::end(void)
+	{
+		flush();
+	}
+
+	#define RENDER_QUEUE_COMMAND_BIT 0x80000000u
+
+	render_queue::render_queue(unsigned int capacity)
+	{
+		items.resize(capacity);
+		sort_scratch.resize(capacity);
+		sprites.reserve(capacity);
+		commands.reserve(capacity);
+		n_items = 0, state_changes = 0;
+	}
+
+	unsigned long long render_queue::makeKey(unsigned char layer, blend_mode blend, render_mode mode, primitive_mode prim, unsigned short texture_id, float depth)
+	{
+		// flip float bits so they sort as unsigned integers: negative values reversed, positive above them
+		unsigned int depth_bits;
+		memcpy(&depth_bits, &depth, sizeof(depth_bits));
+		depth_bits = (depth_bits & 0x80000000u) ? ~depth_bits : (depth_bits | 0x80000000u);
+
+		return ((unsigned long long)layer << 56) | ((unsigned long long)((unsigned int)blend & 0xF) << 52)
+			| ((unsigned long long)((unsigned int)mode & 0x7) << 49) | ((unsigned long long)((unsigned int)prim & 0x1) << 48)
+			| ((unsigned long long)texture_id << 32) | depth_bits;
+	}
+
+	void render_queue::submit(const sprite &s, unsigned char layer, blend_mode blend, render_mode mode, primitive_mode prim, float depth)
+	{
+		if (n_items >= items.size()) {
+			writeToLog("Render queue full, sprite dropped!");
+			return;
+		}
+		unsigned short texture_id = (s.sprite_texture != nullptr) ? s.sprite_texture->getId() : 0;
+		items[n_items++] = {makeKey(layer, blend, mode, prim, texture_id, depth), (unsigned int)sprites.size()};
+		sprites.push_back(s);
+	}
+
+	void render_queue::submit(void (*draw)(void *), void *data, texture *tex, unsigned char layer, blend_mode blend, render_mode mode, float depth)
+	{
+		if (n_items >= items.size()) {
+			writeToLog("Render queue full, draw dropped!");
+			return;
+		}
+		unsigned short texture_id = (tex != nullptr) ? tex->getId() : 0;
+		items[n_items++] = {makeKey(layer, blend, mode, primitive_mode::TRIANGLES, texture_id, depth), (unsigned int)commands.size() | RENDER_QUEUE_COMMAND_BIT};
+		commands.push_back({draw, data, tex});
+	}
+
+	void render_queue::sort(void)
+	{
+		// LSD radix sort on 8 bit digits, stable so equal keys keep submission order. All digit histograms are
+		// built in one pass and digits every key shares (usually most of depth and layer) are skipped.
+		unsigned int counts[8][256] = {};
+		for (unsigned int i = 0; i < n_items; i++) {
+			unsigned long long key = items[i].key;
+			for (int digit = 0; digit < 8; digit++) {
+				counts[digit][(key >> (digit * 8)) & 0xFF]++;
+			}
+		}
+
+		queue_item *src = items.data(), *dst = sort_scratch.data();
+		for (int digit = 0; digit < 8; digit++) {
+			unsigned int *count = counts[digit];
+			if (count[(src[0].key >> (digit * 8)) & 0xFF] == n_items) { continue; }
+			unsigned int offset = 0;
+			for (int b = 0; b < 256; b++) {
+				unsigned int c = count[b];
+				count[b] = offset;
+				offset += c;
+			}
+			for (unsigned int i = 0; i < n_items; i++) {
+				dst[count[(src[i].key >> (digit * 8)) & 0xFF]++] = src[i];
+			}
+			queue_item *tmp = src;
+			src = dst, dst = tmp;
+		}
+		if (src != items.data()) {
+			memcpy(items.data(), src, n_items * sizeof(queue_item));
+		}
+	}
+
+	void render_queue::flush(sprite_batch &batch)
+	{
+		state_changes = 0;
+		if (n_items > 0) {
+			sort();
+
+			unsigned long long previous_state = ~0ull;
+			for (unsigned int i = 0; i < n_items; i++) {
+				const queue_item &item = items[i];
+				unsigned long long item_state = item.key >> 49; // layer, blend and render mode
+				if (item_state != previous_state) {
+					batch.flush(); // pending sprites belong to the old state
+					applyBlendMode((blend_mode)((item.key >> 52) & 0xF));
+					applyRenderMode((render_mode)((item.key >> 49) & 0x7));
+					previous_state = item_state;
+					state_changes++;
+				}
+				if (item.index & RENDER_QUEUE_COMMAND_BIT) {
+					const draw_command &command = commands[item.index & ~RENDER_QUEUE_COMMAND_BIT];
+					batch.flush();
+					if (command.tex != nullptr) {
+						command.tex->bindTexture();
+					}
+					command.draw(command.data);
+				} else {
+					batch.draw(sprites[item.index], (primitive_mode)((item.key >> 48) & 0x1));
+				}
+			}
+			batch.flush();
+		}
+		n_items = 0;
+		sprites.clear();
+		commands.clear();
+	}
+
+	static_list::static_list(unsigned int size_bytes)
+	{
+		list_size = size_bytes;
+		list = (unsigned int *)memalign(16, size_bytes);
+		used_bytes = 0;
+		dirty = true;
+	}
+
+	static_list::~static_list()
+	{
+		free(list);
+	}
+
+	bool static_list::beginRecording(void)
+	{
+		if (list == nullptr) {
+			writeToLog("Unable to record static list!");
+			return false;
+		}
+		// upload pending view/projection changes to the frame's list so they don't get baked into this one
+		sceGumUpdateMatrix();
+		// the Gu writes the list through the uncached mirror, so drop any cached lines first
+		sceKernelDcacheWritebackInvalidateRange(list, list_size);
+		sceGuStart(GU_CALL, list);
+		state::invalidate(); // the recording can't rely on whatever state the GE has when it's replayed
+		recording_static_list = true;
+		frame::beginNestedList(list_size); // vertex data has to live in this list, not in the frame's
+		return true;
+	}
+
+	bool static_list::endRecording(void)
+	{
+		used_bytes = sceGuFinish(); // returns to the list that was active before beginRecording
+		recording_static_list = false;
+		bool fits = frame::endNestedList();
+		state::invalidate(); // nothing recorded has actually been executed yet
+		dirty = false;
+		if (!fits || used_bytes > list_size) {
+			char buff[256];
+			sprintf(buff, "Static list overflow: geometry dropped with %u of %u bytes used!", used_bytes, list_size);
+			writeToLog(buff);
+			used_bytes = 0; // an incomplete recording isn't replayed, markDirty and a bigger list to try again
+			return false;
+		}
+		return true;
+	}
+
+	void static_list::call(void)
+	{
+		if (used_bytes == 0 || dirty) { return; }
+		// Gum only writes matrices when something is drawn, the camera set this frame has to reach the GE first
+		sceGumUpdateMatrix();
+		// the model matrix is left as the recorded geometry set it, callers load their own before drawing
+		sceGuCallList(list);
+		state::invalidate();
+	}
+
+	texture_atlas::texture_atlas()
+	{
+
+	}
+
+	bool texture_atlas::loadAtlas(const char *filename, texture_manager &manager, texture_format format, bool dither)
+	{
+		int fd = sceIoOpen(filename, PSP_O_RDONLY, 0777);
+		if (fd < 0) {
+			writeToLog("Unable to open atlas!");
+			return false;
+		}
+		int size = sceIoLseek32(fd, 0, PSP_SEEK_END);
+		sceIoLseek32(fd, 0, PSP_SEEK_SET);
+		std::string text(size, '\0');
+		sceIoRead(fd, &text[0], size);
+		sceIoClose(fd);
+
+		/*
+		* line based format:
+		*   image <filename> <width> <height>
+		*   sprite <name> <x> <y> <width> <height>
+		* anything else (comments, blank lines) is ignored
+		*/
+		entries.clear();
+		ids.clear();
+		atlas_texture.reset();
+		std::string image;
+		size_t line_start = 0;
+		while (line_start < text.size()) {
+			size_t line_end = text.find('\n', line_start);
+			if (line_end == std::string::npos) { line_end = text.size(); }
+			std::string line = text.substr(line_start, line_end - line_start);
+			line_start = line_end + 1;
+
+			char name[128];
+			atlas_entry entry;
+			if (sscanf(line.c_str(), "image %127s", name) == 1) {
+				image = name;
+			} else if (sscanf(line.c_str(), "sprite %127s %d %d %d %d", name, &entry.x, &entry.y, &entry.width, &entry.height) == 5) {
+				ids[name] = entries.size();
+				entries.push_back(entry);
+			}
+		}
+
+		atlas_texture = manager.share(manager.addTexture(image, format, dither));
+		if (atlas_texture.get() == nullptr) {
+			writeToLog("Unable to load atlas image!");
+			return false;
+		}
+
+		// texture_quad uvs cover the padded texture, so normalize against the padded size
+		float pw = atlas_texture.get()->getPixelWidth(), ph = atlas_texture.get()->getPixelHeight();
+		for (atlas_entry &e : entries) {
+			e.uv = {e.x / pw, e.y / ph, (e.x + e.width) / pw, (e.y + e.height) / ph};
+		}
+		return true;
+	}
+
+	int texture_atlas::getSpriteId(const char *name)
+	{
+		auto it = ids.find(name);
+		return (it == ids.end()) ? -1 : it->second;
+	}
+
+	uv_rect texture_atlas::getUV(int id)
+	{
+		if (id < 0 || id >= (int)entries.size()) { return {0.0f, 0.0f, 0.0f, 0.0f}; }
+		return entries[id].uv;
+	}
+
+	uv_rect texture_atlas::getUV(const char *name)
+	{
+		return getUV(getSpriteId(name));
+	}
+
+	texture_manager::texture_manager() : ids(TEXTURE_MANAGER_SLOTS)
+	{
+		for (unsigned int i = 0; i < TEXTURE_MANAGER_SLOTS; i++) {
+			slots[i].refs = 0;
+		}
+		vram_budget = 0, resident_bytes = 0, bind_clock = 0;
+		stats_frame = frame_number;
+		stats = {};
+		loader = nullptr;
+	}
+
+	texture_manager::~texture_manager()
+	{
+		delete loader; // waits for the load in progress
+		clear();
+	}
+
+	texture_handle texture_manager::addTexture(std::string filename, texture_format format, bool dither, bool mipmaps)
+	{
+		texture_handle existing = find(filename.c_str());
+		if (existing.isValid() && slots[existing.index].filename == filename) { return existing; } // a colliding name fails in claimSlot
+		// the master copy stays in RAM, VRAM is only used as a cache on bind
+		texture temp_texture = texture(filename.c_str(), GU_FALSE, format, dither, mipmaps);
+		if (temp_texture.getTextureData() == nullptr) { return {0, 0}; }
+		return claimSlot(filename, std::move(temp_texture)); // freed with temp_texture when there's no slot for it
+	}
+
+	texture_handle texture_manager::addTextureAsync(std::string filename, texture_format format, bool dither)
+	{
+		texture_handle existing = find(filename.c_str());
+		if (existing.isValid() && slots[existing.index].filename == filename) { return existing; }
+		if (placeholder.getTextureData() == nullptr) { // also after clear
+			createPlaceholder();
+		}
+		if (loader == nullptr) {
+			loader = new async_loader();
+		}
+		texture pending_texture;
+		pending_texture.borrow(placeholder);
+		texture_handle handle = claimSlot(filename, std::move(pending_texture));
+		if (handle.isValid()) {
+			int psm = (format == texture_format::INDEXED) ? -1 : formatPsm(format);
+			loading[loader->request(filename, psm, dither)] = handle;
+		}
+		return handle;
+	}
+
+	texture_handle texture_manager::claimSlot(const std::string &filename, texture &&tex)
+	{
+		unsigned int name_hash = hashName(filename.c_str());
+		char buff[256];
+		if (names.count(name_hash) > 0) {
+			sprintf(buff, "Texture names %s and %s hash the same, rename one!", filename.c_str(), slots[names[name_hash]].filename.c_str());
+			writeToLog(buff);
+			return {0, 0};
+		}
+		texture_handle handle = ids.allocate();
+		if (!handle.isValid()) {
+			sprintf(buff, "Texture manager full, %s not added!", filename.c_str());
+			writeToLog(buff);
+			return {0, 0};
+		}
+		unsigned short index = handle.index;
+		texture_slot &slot = slots[index];
+		slot.tex = std::move(tex);
+		slot.tex.setId(index + 1); // stable for as long as the texture lives, render_queue sorts on it
+		slot.tex.cache = this; // slots don't move, so the cache can keep pointers to them
+		slot.filename = filename;
+		slot.refs = 0;
+		names[name_hash] = index;
+		return handle;
+	}
+
+	texture *texture_manager::get(texture_handle handle)
+	{
+		return ids.isAlive(handle) ? &slots[handle.index].tex : nullptr;
+	}
+
+	texture_handle texture_manager::find(unsigned int name_hash)
+	{
+		auto it = names.find(name_hash);
+		if (it == names.end()) { return {0, 0}; }
+		return ids.getHandle(it->second);
+	}
+
+	unsigned int texture_manager::publishLoaded(void)
+	{
+		if (loader == nullptr) { return 0; }
+		unsigned int published = 0;
+		loaded_image image;
+		while (loader->poll(image)) {
+			auto waiting = loading.find(image.id);
+			texture_handle handle = (waiting != loading.end()) ? waiting->second : texture_handle{0, 0};
+			texture *tex = get(handle); // a removed texture's handle is stale by now, even if the slot was reused
+			if (waiting != loading.end()) {
+				loading.erase(waiting);
+			}
+			if (tex == nullptr || !tex->pending || !image.ok) { // removed while loading, or failed and left on the placeholder
+				if (tex != nullptr) {
+					char buff[256];
+					sprintf(buff, "Unable to load texture %s!", slots[handle.index].filename.c_str());
+					writeToLog(buff);
+				}
+				free(image.data);
+				free(image.clut);
+			} else {
+				tex->adoptImage(image.layout, image.data, image.clut);
+				char buff[256];
+				sprintf(buff, "Texture %s loaded in the background: %s %dx%d, %u bytes, %.2f ms on the worker", slots[handle.index].filename.c_str(),
+					psmName(tex->psm), tex->pixel_width, tex->pixel_height, tex->getSizeBytes() + tex->clut_entries * 4, image.load_us / 1000.0f);
+				writeToLog(buff);
+				published++;
+			}
+		}
+		if (published > 0) { // the worker's writes may still be in the data cache
+			sceKernelDcacheWritebackInvalidateAll();
+		}
+		return published;
+	}
+
+	void texture_manager::createPlaceholder(void)
+	{
+		unsigned int pixels[16 * 16];
+		for (unsigned int i = 0; i < 16 * 16; i++) {
+			pixels[i] = (((i % 16) / 4 + (i / 64)) & 1) ? 0xFFC0C0C0 : 0xFF808080;
+		}
+		texconv::image_layout layout = texconv::layoutFor(texconv::psm::RGBA8888, 16, 16);
+		void *data = memalign(16, layout.data_size);
+		if (data == nullptr) { return; } // binding a texture with no data is a no-op
+		texconv::convertImage(pixels, layout, false, data, nullptr);
+		placeholder.adoptImage(layout, data, nullptr);
+		sceKernelDcacheWritebackInvalidateAll();
+	}
+
+	void texture_manager::removeTexture(texture_handle handle)
+	{
+		if (get(handle) == nullptr) { return; }
+		texture_slot &slot = slots[handle.index];
+		if (slot.refs > 0) {
+			char buff[256];
+			sprintf(buff, "Texture %s still has %u references, not removed!", slot.filename.c_str(), slot.refs);
+			writeToLog(buff);
+			return;
+		}
+		freeSlot(handle.index);
+	}
+
+	void texture_manager::freeSlot(unsigned short index)
+	{
+		texture_slot &slot = slots[index];
+		if (slot.tex.pending || slot.tex.texture_data == nullptr) {
+			slot.tex.unloadTexture(); // whatever the worker still returns for it is dropped by publishLoaded
+		} else { // the GE may still be drawing with it, releaseRetired frees it once the frame has been synced
+			void *vram_copy = detach(slot.tex);
+			texture *tex = new texture(std::move(slot.tex));
+			tex->cache = nullptr; // can outlive the manager
+			retired_textures.push_back({tex, vram_copy, frame_number});
+		}
+		names.erase(hashName(slot.filename.c_str()));
+		slot.tex = texture();
+		slot.filename.clear();
+		slot.refs = 0;
+		ids.release(ids.getHandle(index));
+	}
+
+	void texture_manager::clear(void)
+	{
+		for (unsigned short index = 0; index < TEXTURE_MANAGER_SLOTS; index++) {
+			if (ids.isUsed(index)) {
+				freeSlot(index);
+			}
+		}
+		evictAll();
+		placeholder.unloadTexture(); // pending slots borrowing it are gone, addTextureAsync makes a new one
+	}
+
+	texture_ref texture_manager::share(texture_handle handle)
+	{
+		return texture_ref(this, handle);
+	}
+
+	void texture_manager::retain(texture_handle handle)
+	{
+		if (get(handle) != nullptr) {
+			slots[handle.index].refs++;
+		}
+	}
+
+	void texture_manager::release(texture_handle handle)
+	{
+		if (get(handle) == nullptr) { return; } // cleared while the reference was held
+		texture_slot &slot = slots[handle.index];
+		if (slot.refs > 0 && --slot.refs == 0) {
+			freeSlot(handle.index);
+		}
+	}
+
+	texture_ref::texture_ref()
+	{
+		manager = nullptr;
+		handle = {0, 0};
+	}
+
+	texture_ref::texture_ref(texture_manager *owner, texture_handle texture_slot)
+	{
+		manager = nullptr;
+		handle = {0, 0};
+		if (owner != nullptr && owner->get(texture_slot) != nullptr) {
+			manager = owner, handle = texture_slot;
+			manager->retain(handle);
+		}
+	}
+
+	texture_ref::texture_ref(const texture_ref &other)
+	{
+		manager = other.manager, handle = other.handle;
+		if (manager != nullptr) {
+			manager->retain(handle);
+		}
+	}
+
+	texture_ref::texture_ref(texture_ref &&other)
+	{
+		manager = other.manager, handle = other.handle;
+		other.manager = nullptr, other.handle = {0, 0};
+	}
+
+	texture_ref &texture_ref::operator=(texture_ref other) // copy or move made by the caller, the old reference goes with other
+	{
+		std::swap(manager, other.manager);
+		std::swap(handle, other.handle);
+		return *this;
+	}
+
+	texture_ref::~texture_ref()
+	{
+		reset();
+	}
+
+	void texture_ref::reset(void)
+	{
+		if (manager != nullptr) {
+			manager->release(handle);
+		}
+		manager = nullptr, handle = {0, 0};
+	}
+
+	texture *texture_ref::get(void) const
+	{
+		return (manager != nullptr) ? manager->get(handle) : nullptr;
+	}
+
+	void texture_manager::rollStats(void)
+	{
+		if (stats_frame == frame_number) { return; }
+		stats = {};
+		stats_frame = frame_number;
+	}
+
+	const void *texture_manager::makeResident(texture &tex)
+	{
+		if (tex.in_vram || tex.pending || tex.texture_data == nullptr) { return tex.texture_data; }
+		rollStats();
+		tex.last_bind = ++bind_clock;
+		tex.last_frame = frame_number;
+		if (tex.vram_data != nullptr) {
+			stats.hits++;
+			return tex.vram_data;
+		}
+		stats.misses++;
+
+		unsigned int size = tex.getSizeBytes();
+		// bigger than everything evicting could free, trying would flush the whole cache on every bind and still miss
+		unsigned int capacity = vram::getStats().free + resident_bytes;
+		if (vram_budget != 0 && vram_budget < capacity) {
+			capacity = vram_budget;
+		}
+		if (size > capacity) {
+			stats.fallbacks++;
+			return tex.texture_data;
+		}
+		// only allocate once it can succeed, a failed vram::allocate writes to the log
+		unsigned int block_size = (size + VRAM_ALIGNMENT - 1) & ~(VRAM_ALIGNMENT - 1);
+		void *block = nullptr;
+		do {
+			if ((vram_budget == 0 || resident_bytes + size <= vram_budget) && vram::getStats().largest_free >= block_size) {
+				block = vram::allocate(size, VRAM_ALIGNMENT, &tex.vram_data);
+				break;
+			}
+		} while (evictOldest());
+		if (block == nullptr) {
+			stats.fallbacks++;
+			return tex.texture_data;
+		}
+		tex.vram_data = block;
+		resident.push_back(&tex);
+		resident_bytes += size;
+
+		// the GE copies it in list order, so draws already in the list that sampled an evicted texture from
+		// this block (this frame or the one still executing) finish before it's overwritten
+		// copied as 32 bit words whatever the texture format, the swizzled layout is just bytes to the GE
+		// one copy per mip level keeps each within the GE's 1024 row limit
+		unsigned int offset = 0;
+		for (unsigned int level = 0; level < tex.mip_levels; level++) {
+			unsigned int level_size = tex.getLevelSize(level);
+			unsigned int row_words = std::max(level_size / (tex.pixel_height >> level) / 4, 1u), rows = level_size / 4 / row_words; // narrow DXT1 has rows under a word
+			sceGuCopyImage(GU_PSM_8888, 0, 0, row_words, rows, row_words, (unsigned char *)tex.texture_data + offset, 0, 0, row_words, (unsigned char *)block + offset);
+			offset += level_size;
+		}
+		sceGuTexSync();
+		sceGuTexFlush(); // the block may have held a texture at the same address the state cache still has bound
+		stats.uploaded_bytes += size;
+		return block;
 	}
 
-	 texture_manager::texture_manager() {}
-	 texture_manager::~texture_manager() {}
+	void *texture_manager::detach(texture &tex)
+	{
+		void *block = tex.vram_data;
+		if (block == nullptr) { return nullptr; }
+		for (size_t i = 0; i < resident.size(); i++) {
+			if (resident[i] == &tex) {
+				resident[i] = resident.back();
+				resident.pop_back();
+				break;
+			}
+		}
+		tex.vram_data = nullptr;
+		resident_bytes -= tex.getSizeBytes();
+		return block;
+	}
 
-	void texture_manager::addTexture(std::string filename)
+	void texture_manager::evict(texture &tex)
 	{
-		texture temp_texture = texture(filename.c_str(), GU_TRUE);
-		if (temp_texture.getTextureData() == nullptr) { return; }
-		textures.insert({filename, temp_texture});
+		void *block = detach(tex);
+		if (block == nullptr) { return; }
+		vram::release(block);
+		rollStats();
+		stats.evictions++;
 	}
 
-	void texture_manager::removeTexture(std::string filename)
+	void texture_manager::evictAll(void)
 	{
-		textures.erase(filename);
+		while (!resident.empty()) {
+			evict(*resident.back());
+		}
+	}
+
+	bool texture_manager::evictOldest(void)
+	{
+		texture *oldest = nullptr;
+		for (texture *tex : resident) {
+			if (tex->last_frame != frame_number && (oldest == nullptr || tex->last_bind < oldest->last_bind)) {
+				oldest = tex;
+			}
+		}
+		if (oldest == nullptr) { return false; }
+		evict(*oldest);
+		return true;
+	}
+
+	residency_stats texture_manager::getResidencyStats(void)
+	{
+		rollStats();
+		residency_stats current = stats;
+		current.resident_bytes = resident_bytes;
+		current.resident_textures = resident.size();
+		return current;
+	}
+
+	void texture_manager::logResidency(void)
+	{
+		residency_stats current = getResidencyStats();
+		char buff[256];
+		sprintf(buff, "Texture cache: %u hits, %u misses, %u bytes uploaded, %u evictions, %u from RAM, %u textures (%u bytes) resident",
+			current.hits, current.misses, current.uploaded_bytes, current.evictions, current.fallbacks, current.resident_textures, current.resident_bytes);
+		writeToLog(buff);
 	}
 
 	camera2D::camera2D(float x, float y) 
@@ -245,6 +1286,7 @@ namespace nucleus
 		camera_pos.x = x;
 		camera_pos.y = y;
 		camera_pos.z = 0.0f;
+		zoom = 1.0f;
 		camera_target = camera_pos;
 	}
 
@@ -267,14 +1309,382 @@ namespace nucleus
 		camera_pos.y += (camera_target.y - camera_pos.y) * smoothing_factor * dt;
 	}
 
+	rect camera2D::getVisibleRect(void)
+	{
+		// setCamera translates by -camera_pos, scales by zoom and the projection shows 0..PSP_SCR_WIDTH by 0..PSP_SCR_HEIGHT
+		return {camera_pos.x, camera_pos.y, PSP_SCR_WIDTH / zoom, PSP_SCR_HEIGHT / zoom};
+	}
+
 	void camera2D::setCamera(void) 
 	{
 		sceGumMatrixMode(GU_VIEW);
 		sceGumLoadIdentity();
+		ScePspFVector3 scale = {zoom, zoom, 1.0f};
+		sceGumScale(&scale);
 		ScePspFVector3 translated_pos = {-camera_pos.x, -camera_pos.y, camera_pos.z};
 		sceGumTranslate(&translated_pos);
 	}
 
+	static void *frame_buffers[2]; // VRAM offsets of the draw and display buffers set up by initGraphics
+
+	// finish times written by the GE finish callback, indexed by frame_pipeline list
+	static volatile unsigned int ge_finish_times[2];
+
+	static void pipelineFinishCallback(int id)
+	{
+		// the pipeline finishes its lists with id 1 and 2, 0 comes from plain sceGuFinish
+		if (id == 1 || id == 2) {
+			ge_finish_times[id - 1] = sceKernelGetSystemTimeLow();
+		}
+	}
+
+	frame_pipeline::frame_pipeline(void *list_a, void *list_b)
+	{
+		lists[0] = list_a, lists[1] = list_b;
+		list_ids[0] = -1, list_ids[1] = -1;
+		kick_times[0] = 0, kick_times[1] = 0;
+		current = 0;
+		build_start = 0;
+		cpu_time = 0.0f, ge_time = 0.0f, wait_time = 0.0f;
+		sceGuSetCallback(GU_CALLBACK_FINISH, pipelineFinishCallback);
+	}
+
+	void frame_pipeline::syncList(unsigned int index)
+	{
+		if (list_ids[index] < 0) { return; }
+		sceGeListSync(list_ids[index], GU_SYNC_WAIT);
+		list_ids[index] = -1;
+		ge_time = (ge_finish_times[index] - kick_times[index]) / 1000000.0f;
+	}
+
+	void frame_pipeline::startFrame(void)
+	{
+		build_start = sceKernelGetSystemTimeLow();
+		frame_number++;
+		state::resetCounters();
+		cull::resetCounters();
+		frame::reset(1); // the GE may still be drawing the previous frame
+		releaseRetired(1);
+		// this list was synced at the end of the previous frame, so it's free to overwrite
+		sceGuStart(GU_SEND, lists[current]);
+		sceGuDrawBufferList(GU_PSM_8888, frame_buffers[current], PSP_BUF_WIDTH);
+	}
+
+	void frame_pipeline::endFrame(void)
+	{
+		sceGuFinishId(current + 1);
+		unsigned int build_end = sceKernelGetSystemTimeLow();
+		cpu_time = (build_end - build_start) / 1000000.0f;
+
+		// the previous frame's list is the one reused next, once it's done its framebuffer can be shown
+		unsigned int previous = current ^ 1;
+		bool presented = list_ids[previous] >= 0;
+		syncList(previous);
+		wait_time = (sceKernelGetSystemTimeLow() - build_end) / 1000000.0f;
+		if (presented) {
+			sceDisplaySetFrameBuf((char *)sceGeEdramGetAddr() + (unsigned int)frame_buffers[previous], PSP_BUF_WIDTH, PSP_DISPLAY_PIXEL_FORMAT_8888, PSP_DISPLAY_SETBUF_NEXTFRAME);
+		}
+		sceDisplayWaitVblankStart();
+
+		// the framebuffer this frame draws into is no longer on screen, let the GE start on it
+		kick_times[current] = sceKernelGetSystemTimeLow();
+		list_ids[current] = sceGuSendList(GU_TAIL, lists[current], nullptr);
+		current = previous;
+	}
+
+	void frame_pipeline::drain(void)
+	{
+		syncList(current ^ 1);
+		syncList(current);
+	}
+
+	namespace state
+	{
+		#define N_GE_LIGHTS 4
+		#define N_GE_MIPMAPS 8
+
+		/*
+		* Every group of values has a 'known' flag, cleared by invalidate, so the first call after it always emits.
+		* Enables are tracked as bits since GU_ALPHA_TEST..GU_FRAGMENT_2X all fit in 32.
+		*/
+		struct shadow_state
+		{
+			unsigned int enabled, enabled_known;
+			bool blend_known;
+			int blend_op, blend_src, blend_dest;
+			unsigned int blend_srcfix, blend_destfix;
+			bool clut_mode_known;
+			int clut_psm, clut_shift, clut_mask, clut_a3;
+			bool clut_load_known;
+			int clut_blocks;
+			const void *clut_address;
+			bool tex_mode_known;
+			int tex_psm, tex_maxmips, tex_a2, tex_swizzle;
+			bool tex_level_known;
+			int tex_level_mode;
+			float tex_level_bias;
+			bool tex_func_known;
+			int tex_tfx, tex_tcc;
+			bool tex_filter_known;
+			int tex_min, tex_mag;
+			bool tex_wrap_known;
+			int tex_wrap_u, tex_wrap_v;
+			bool tex_image_known[N_GE_MIPMAPS];
+			int tex_width[N_GE_MIPMAPS], tex_height[N_GE_MIPMAPS], tex_tbw[N_GE_MIPMAPS];
+			const void *tex_tbp[N_GE_MIPMAPS];
+			bool tex_scale_known;
+			float tex_scale_u, tex_scale_v;
+			unsigned int material_known; // GU_AMBIENT/GU_DIFFUSE/GU_SPECULAR bits
+			int material_colors[3];
+			bool ambient_known;
+			unsigned int ambient_color;
+			bool light_known[N_GE_LIGHTS];
+			int light_type[N_GE_LIGHTS], light_components[N_GE_LIGHTS];
+			ScePspFVector3 light_position[N_GE_LIGHTS];
+			unsigned int light_color_known[N_GE_LIGHTS];
+			unsigned int light_colors[N_GE_LIGHTS][3];
+		};
+
+		static shadow_state current = {};
+		static unsigned int emitted = 0, skipped = 0;
+
+		// returns true (and counts it) when the command has to be sent
+		static bool changed(bool same)
+		{
+			if (same) {
+				skipped++;
+				return false;
+			}
+			emitted++;
+			return true;
+		}
+
+		// index into material/light color arrays for a single GU_AMBIENT, GU_DIFFUSE or GU_SPECULAR bit
+		static int componentIndex(int component)
+		{
+			return (component == GU_AMBIENT) ? 0 : (component == GU_DIFFUSE) ? 1 : 2;
+		}
+
+		void invalidate(void)
+		{
+			current = {};
+		}
+
+		void enable(int state)
+		{
+			unsigned int bit = 1u << state;
+			if (changed((current.enabled_known & bit) && (current.enabled & bit))) {
+				sceGuEnable(state);
+				current.enabled |= bit, current.enabled_known |= bit;
+			}
+		}
+
+		void disable(int state)
+		{
+			unsigned int bit = 1u << state;
+			if (changed((current.enabled_known & bit) && !(current.enabled & bit))) {
+				sceGuDisable(state);
+				current.enabled &= ~bit, current.enabled_known |= bit;
+			}
+		}
+
+		void blendFunc(int op, int src, int dest, unsigned int srcfix, unsigned int destfix)
+		{
+			if (changed(current.blend_known && current.blend_op == op && current.blend_src == src && current.blend_dest == dest
+				&& current.blend_srcfix == srcfix && current.blend_destfix == destfix)) {
+				sceGuBlendFunc(op, src, dest, srcfix, destfix);
+				current.blend_known = true;
+				current.blend_op = op, current.blend_src = src, current.blend_dest = dest;
+				current.blend_srcfix = srcfix, current.blend_destfix = destfix;
+			}
+		}
+
+		void texMode(int tpsm, int maxmips, int a2, int swizzle)
+		{
+			if (changed(current.tex_mode_known && current.tex_psm == tpsm && current.tex_maxmips == maxmips
+				&& current.tex_a2 == a2 && current.tex_swizzle == swizzle)) {
+				sceGuTexMode(tpsm, maxmips, a2, swizzle);
+				current.tex_mode_known = true;
+				current.tex_psm = tpsm, current.tex_maxmips = maxmips, current.tex_a2 = a2, current.tex_swizzle = swizzle;
+			}
+		}
+
+		void texLevelMode(int mode, float bias)
+		{
+			if (changed(current.tex_level_known && current.tex_level_mode == mode && current.tex_level_bias == bias)) {
+				sceGuTexLevelMode(mode, bias);
+				current.tex_level_known = true;
+				current.tex_level_mode = mode, current.tex_level_bias = bias;
+			}
+		}
+
+		void clutMode(int cpsm, int shift, int mask, int a3)
+		{
+			if (changed(current.clut_mode_known && current.clut_psm == cpsm && current.clut_shift == shift
+				&& current.clut_mask == mask && current.clut_a3 == a3)) {
+				sceGuClutMode(cpsm, shift, mask, a3);
+				current.clut_mode_known = true;
+				current.clut_psm = cpsm, current.clut_shift = shift, current.clut_mask = mask, current.clut_a3 = a3;
+			}
+		}
+
+		void clutLoad(int num_blocks, const void *cbp)
+		{
+			// palettes are never rewritten in place, so the address identifies what's loaded
+			if (changed(current.clut_load_known && current.clut_blocks == num_blocks && current.clut_address == cbp)) {
+				sceGuClutLoad(num_blocks, cbp);
+				current.clut_load_known = true;
+				current.clut_blocks = num_blocks, current.clut_address = cbp;
+			}
+		}
+
+		void texFunc(int tfx, int tcc)
+		{
+			if (changed(current.tex_func_known && current.tex_tfx == tfx && current.tex_tcc == tcc)) {
+				sceGuTexFunc(tfx, tcc);
+				current.tex_func_known = true;
+				current.tex_tfx = tfx, current.tex_tcc = tcc;
+			}
+		}
+
+		void texFilter(int min, int mag)
+		{
+			if (changed(current.tex_filter_known && current.tex_min == min && current.tex_mag == mag)) {
+				sceGuTexFilter(min, mag);
+				current.tex_filter_known = true;
+				current.tex_min = min, current.tex_mag = mag;
+			}
+		}
+
+		void texWrap(int u, int v)
+		{
+			if (changed(current.tex_wrap_known && current.tex_wrap_u == u && current.tex_wrap_v == v)) {
+				sceGuTexWrap(u, v);
+				current.tex_wrap_known = true;
+				current.tex_wrap_u = u, current.tex_wrap_v = v;
+			}
+		}
+
+		void texImage(int mipmap, int width, int height, int tbw, const void *tbp)
+		{
+			if (changed(current.tex_image_known[mipmap] && current.tex_width[mipmap] == width && current.tex_height[mipmap] == height
+				&& current.tex_tbw[mipmap] == tbw && current.tex_tbp[mipmap] == tbp)) {
+				sceGuTexImage(mipmap, width, height, tbw, tbp);
+				current.tex_image_known[mipmap] = true;
+				current.tex_width[mipmap] = width, current.tex_height[mipmap] = height;
+				current.tex_tbw[mipmap] = tbw, current.tex_tbp[mipmap] = tbp;
+			}
+		}
+
+		void texScale(float u, float v)
+		{
+			if (changed(current.tex_scale_known && current.tex_scale_u == u && current.tex_scale_v == v)) {
+				sceGuTexScale(u, v);
+				current.tex_scale_known = true;
+				current.tex_scale_u = u, current.tex_scale_v = v;
+			}
+		}
+
+		void material(int mode, int color)
+		{
+			// sceGuMaterial sets each component in mode separately, so only send the ones that differ
+			int send = 0;
+			for (int component : {GU_AMBIENT, GU_DIFFUSE, GU_SPECULAR}) {
+				if (!(mode & component)) { continue; }
+				int i = componentIndex(component);
+				if (changed((current.material_known & component) && current.material_colors[i] == color)) {
+					send |= component;
+					current.material_known |= component;
+					current.material_colors[i] = color;
+				}
+			}
+			if (send) {
+				sceGuMaterial(send, color);
+			}
+		}
+
+		void ambient(unsigned int color)
+		{
+			if (changed(current.ambient_known && current.ambient_color == color)) {
+				sceGuAmbient(color);
+				current.ambient_known = true;
+				current.ambient_color = color;
+			}
+		}
+
+		void light(int light, int type, int components, const ScePspFVector3 *position)
+		{
+			const ScePspFVector3 &p = current.light_position[light];
+			if (changed(current.light_known[light] && current.light_type[light] == type && current.light_components[light] == components
+				&& p.x == position->x && p.y == position->y && p.z == position->z)) {
+				sceGuLight(light, type, components, position);
+				current.light_known[light] = true;
+				current.light_type[light] = type, current.light_components[light] = components;
+				current.light_position[light] = *position;
+			}
+		}
+
+		void lightColor(int light, int component, unsigned int color)
+		{
+			// sent one component at a time, sceGuLightColor doesn't accept every combination of bits
+			for (int c : {GU_AMBIENT, GU_DIFFUSE, GU_SPECULAR}) {
+				if (!(component & c)) { continue; }
+				int i = componentIndex(c);
+				if (changed((current.light_color_known[light] & c) && current.light_colors[light][i] == color)) {
+					sceGuLightColor(light, c, color);
+					current.light_color_known[light] |= c;
+					current.light_colors[light][i] = color;
+				}
+			}
+		}
+
+		void resetCounters(void)
+		{
+			emitted = 0, skipped = 0;
+		}
+
+		unsigned int getEmittedCount(void) {return emitted;}
+		unsigned int getSkippedCount(void) {return skipped;}
+	}
+
+	namespace cull
+	{
+		static unsigned int culled = 0, drawn = 0;
+
+		bool isVisible(const rect &view, const rect &bounds)
+		{
+			if (overlaps(view, bounds)) {
+				drawn++;
+				return true;
+			}
+			culled++;
+			return false;
+		}
+
+		unsigned int cullRects(const rect &view, const rect *bounds, unsigned int count, unsigned int *visible)
+		{
+			unsigned int n_visible = 0;
+			float view_right = view.x + view.width, view_bottom = view.y + view.height;
+			for (unsigned int i = 0; i < count; i++) {
+				const rect &b = bounds[i];
+				// branch free so the loop doesn't stall on unpredictable results, index is always written
+				visible[n_visible] = i;
+				n_visible += (b.x < view_right) & (view.x < b.x + b.width) & (b.y < view_bottom) & (view.y < b.y + b.height);
+			}
+			drawn += n_visible;
+			culled += count - n_visible;
+			return n_visible;
+		}
+
+		void resetCounters(void)
+		{
+			culled = 0, drawn = 0;
+		}
+
+		unsigned int getCulledCount(void) {return culled;}
+		unsigned int getDrawnCount(void) {return drawn;}
+	}
+
 	// nucleus methods
 
 	void writeToLog(const char *message)
@@ -289,34 +1699,32 @@ namespace nucleus
     	}
 	}
 
+	static unsigned int getBufferSize(unsigned int width, unsigned int height, unsigned int psm)
+	{
+		return width * height * bitsPerPixel(psm) / 8;
+	}
+
 	void *getStaticVramBuffer(unsigned int width, unsigned int height, unsigned int psm)
 	{
-		static unsigned int offset = 0;
-		unsigned int buffer_size;
-		if (psm == GU_PSM_8888) {
-			buffer_size = width * height * 4;
-		} else if (psm == GU_PSM_4444) {
-			buffer_size = width * height * 2;
-		} else {
-			return nullptr;
-		}
-		void *buffer = (void*)offset;
-		offset += buffer_size;
-		if (offset >= 2 * 1024 * 1024) { // don't want to exceed 2Mb vram range
+		unsigned int buffer_size = getBufferSize(width, height, psm);
+		void *buffer = (buffer_size > 0) ? vram::allocate(buffer_size) : nullptr;
+		if (buffer == nullptr) {
+			writeToLog("Unable to allocate static VRAM buffer!");
 			return nullptr;
 		}
-		return buffer;
+		return (void*)((unsigned int)buffer - (unsigned int)sceGeEdramGetAddr());
 	}
 
 	void *getStaticVramTexture(unsigned int width, unsigned int height, unsigned int psm)
 	{
-		void *texture = getStaticVramBuffer(width, height, psm);
-		return (void*)(((unsigned int)texture) + ((unsigned int)sceGeEdramGetAddr()));
+		unsigned int buffer_size = getBufferSize(width, height, psm);
+		return (buffer_size > 0) ? vram::allocate(buffer_size) : nullptr;
 	}
 
 	void initGraphics(void *list)
 	{
 		// allocate memory in vram for draw, display, and zbuffers
+		// 2 x 557,056 + 278,528 = 1,392,640 of the 2 MB, about 688 KB is left for textures
 		char buff[256];
 		//void *draw_buffer = guGetStaticVramBuffer(PSP_BUF_WIDTH, PSP_SCR_HEIGHT, GU_PSM_8888);
 		void *draw_buffer = getStaticVramBuffer(PSP_BUF_WIDTH, PSP_SCR_HEIGHT, GU_PSM_8888);
@@ -330,6 +1738,7 @@ namespace nucleus
 		void *z_buffer = getStaticVramBuffer(PSP_BUF_WIDTH, PSP_SCR_HEIGHT, GU_PSM_4444);
 		// sprintf(buff, "Z buffer allocated at: %p", z_buffer);
 		// writeToLog(buff);
+		frame_buffers[0] = draw_buffer, frame_buffers[1] = disp_buffer;
 		// configure Gu
 		sceGuInit();
 		sceGuStart(GU_DIRECT, list);
@@ -376,21 +1785,21 @@ namespace nucleus
 	void initLighting(void *list)
 	{
 		sceGuStart(GU_DIRECT, list);
-		sceGuEnable(GU_LIGHTING);
+		state::enable(GU_LIGHTING);
 
     	// Setup light 0 as a directional light
-    	sceGuEnable(GU_LIGHT0);
+    	state::enable(GU_LIGHT0);
     	ScePspFVector3 light_direction = {0.0f, 0.0f, 1.0f}; // Light coming from the viewer towards the screen
-    	sceGuLight(0, GU_DIRECTIONAL, GU_DIFFUSE_AND_SPECULAR, &light_direction);
+    	state::light(0, GU_DIRECTIONAL, GU_DIFFUSE_AND_SPECULAR, &light_direction);
 
     	// Set light colors (RGBA)
-    	sceGuLightColor(0, GU_DIFFUSE, GU_COLOR(1.0f, 1.0f, 1.0f, 1.0f)); // White diffuse light
-    	sceGuLightColor(0, GU_SPECULAR, GU_COLOR(0.1f, 0.1f, 0.1f, 1.0f)); // Less intense specular light
+    	state::lightColor(0, GU_DIFFUSE, GU_COLOR(1.0f, 1.0f, 1.0f, 1.0f)); // White diffuse light
+    	state::lightColor(0, GU_SPECULAR, GU_COLOR(0.1f, 0.1f, 0.1f, 1.0f)); // Less intense specular light
 
     	// Set ambient light globally (RGBA)
-    	sceGuAmbient(GU_COLOR(0.4f, 0.4f, 0.4f, 1.0f)); // Dim ambient light
+    	state::ambient(GU_COLOR(0.4f, 0.4f, 0.4f, 1.0f)); // Dim ambient light
 
-		sceGuMaterial(GU_AMBIENT_AND_DIFFUSE, GU_COLOR(0.0f, 1.0f, 0.0f, 1.0f)); // Pinkish material
+		state::material(GU_AMBIENT_AND_DIFFUSE, GU_COLOR(0.0f, 1.0f, 0.0f, 1.0f)); // Pinkish material
 
 		sceGuFinish();
 		sceGuSync(0, 0);
@@ -421,7 +1830,12 @@ namespace nucleus
 
 	void startFrame(void *list)
 	{
+		frame::reset(0); // endFrame waited for the GE
 		sceGuStart(GU_DIRECT, list);
+		frame_number++;
+		releaseRetired(0);
+		state::resetCounters();
+		cull::resetCounters();
 	}
 
 	void endFrame(void)
@@ -435,6 +1849,15 @@ namespace nucleus
 	void termGraphics(void)
 	{
 		sceGuTerm();
+		releaseRetired(0, true);
+		// everything the game loaded should be gone by now, texture_managers included
+		char buff[128];
+		if (texture::getLiveCount() > 0) {
+			sprintf(buff, "Leak check: %u textures (%u bytes) still alive at termGraphics!", texture::getLiveCount(), texture::getLiveBytes());
+		} else {
+			sprintf(buff, "Leak check: no textures alive at termGraphics");
+		}
+		writeToLog(buff);
 	}
 
 	float calculateDeltaTime(u64 &last_time) // returns delta time in seconds
@@ -447,17 +1870,37 @@ namespace nucleus
 		return dt;
 	}	
 
-	void setRenderMode(render_mode mode, void *list)
+	void applyRenderMode(render_mode mode)
 	{
-		sceGuStart(GU_DIRECT, list);
 		if (mode == render_mode::NUCLEUS_PRIMITIVES) {
-			sceGuDisable(GU_TEXTURE_2D);
+			state::disable(GU_TEXTURE_2D);
+			state::disable(GU_LIGHTING);
 		} else if (mode == render_mode::NUCLEUS_TEXTURE2D) {
-			sceGuEnable(GU_TEXTURE_2D);
+			state::enable(GU_TEXTURE_2D);
+			state::disable(GU_LIGHTING);
 		} else if (mode == render_mode::NUCLEUS_LIGHTING2D) {
-			sceGuEnable(GU_TEXTURE_2D);
-			sceGuEnable(GU_LIGHTING);
+			state::enable(GU_TEXTURE_2D);
+			state::enable(GU_LIGHTING);
+		}
+	}
+
+	void applyBlendMode(blend_mode mode)
+	{
+		if (mode == blend_mode::NONE) {
+			state::disable(GU_BLEND);
+		} else if (mode == blend_mode::ALPHA) {
+			state::blendFunc(GU_ADD, GU_SRC_ALPHA, GU_ONE_MINUS_SRC_ALPHA, 0, 0);
+			state::enable(GU_BLEND);
+		} else if (mode == blend_mode::ADDITIVE) {
+			state::blendFunc(GU_ADD, GU_SRC_ALPHA, GU_FIX, 0, 0xFFFFFFFF);
+			state::enable(GU_BLEND);
 		}
+	}
+
+	void setRenderMode(render_mode mode, void *list)
+	{
+		sceGuStart(GU_DIRECT, list);
+		applyRenderMode(mode);
 		sceGuFinish();
 		sceGuSync(0,0);
 		sceDisplayWaitVblankStart();
@@ -504,5 +1947,143 @@ namespace nucleus
 			// render rectangle
 			rectangle_mesh.renderMesh();
 		}
+
+		static unsigned int alignBlock(unsigned int size)
+		{
+			return (size + 15) & ~15;
+		}
+
+		rectangle_pool::rectangle_pool(unsigned int max_rectangles)
+		{
+			capacity = (max_rectangles > 0xFFFF) ? 0xFFFF : max_rectangles;
+			count = 0, front = 0, draw_calls = 0;
+			unsigned int batch = (capacity < RECTANGLE_POOL_BATCH) ? capacity : RECTANGLE_POOL_BATCH;
+			unsigned int array_bytes = alignBlock(capacity * 4), short_bytes = alignBlock(capacity * 2);
+			unsigned int slot_bytes = alignBlock(slot_allocator<rectangle_handle>::getStorageBytes(capacity)), index_bytes = alignBlock(batch * 6 * 2);
+			unsigned int stream_bytes = capacity * 4 * sizeof(vertex);
+			unsigned char *memory = (unsigned char *)memalign(16, stream_bytes * 2 + array_bytes * 5 + short_bytes * 2 + slot_bytes + index_bytes);
+			block = memory;
+			if (memory == nullptr) {
+				writeToLog("Unable to allocate rectangle pool!");
+				capacity = 0;
+				return;
+			}
+			// streams first, they're the only part the GE reads and need the 16 byte alignment
+			streams[0] = (vertex *)memory, memory += stream_bytes;
+			streams[1] = (vertex *)memory, memory += stream_bytes;
+			xs = (float *)memory, memory += array_bytes;
+			ys = (float *)memory, memory += array_bytes;
+			widths = (float *)memory, memory += array_bytes;
+			heights = (float *)memory, memory += array_bytes;
+			colors = (unsigned int *)memory, memory += array_bytes;
+			owners = (unsigned short *)memory, memory += short_bytes;
+			slot_dense = (unsigned short *)memory, memory += short_bytes;
+			ids.init(capacity, memory), memory += slot_bytes;
+			indices = (unsigned short *)memory;
+			// same winding as rectangle's mesh
+			for (unsigned int i = 0; i < batch; i++) {
+				unsigned short *quad_indices = &indices[i * 6];
+				unsigned short first = i * 4;
+				quad_indices[0] = first, quad_indices[1] = first + 1, quad_indices[2] = first + 2;
+				quad_indices[3] = first, quad_indices[4] = first + 2, quad_indices[5] = first + 3;
+			}
+			sceKernelDcacheWritebackRange(indices, batch * 6 * 2);
+		}
+
+		rectangle_pool::~rectangle_pool()
+		{
+			free(block);
+		}
+
+		int rectangle_pool::denseIndex(rectangle_handle handle)
+		{
+			return ids.isAlive(handle) ? slot_dense[handle.index] : -1;
+		}
+
+		rectangle_handle rectangle_pool::add(float width, float height, unsigned int color, ScePspFVector3 position)
+		{
+			rectangle_handle handle = ids.allocate();
+			if (!handle.isValid()) {
+				writeToLog("Rectangle pool full!");
+				return {0, 0};
+			}
+			unsigned int packed = count++;
+			xs[packed] = position.x, ys[packed] = position.y;
+			widths[packed] = width, heights[packed] = height;
+			colors[packed] = color;
+			owners[packed] = handle.index;
+			slot_dense[handle.index] = packed;
+			return handle;
+		}
+
+		void rectangle_pool::remove(rectangle_handle handle)
+		{
+			int packed = denseIndex(handle);
+			if (packed < 0) { return; }
+			// the last rectangle fills the hole, so the arrays stay packed
+			unsigned int last = --count;
+			xs[packed] = xs[last], ys[packed] = ys[last];
+			widths[packed] = widths[last], heights[packed] = heights[last];
+			colors[packed] = colors[last];
+			owners[packed] = owners[last];
+			slot_dense[owners[packed]] = packed;
+			ids.release(handle);
+		}
+
+		void rectangle_pool::changePosition(rectangle_handle handle, ScePspFVector3 *position)
+		{
+			int dense = denseIndex(handle);
+			if (dense < 0) { return; }
+			xs[dense] = position->x, ys[dense] = position->y;
+		}
+
+		void rectangle_pool::setSize(rectangle_handle handle, float width, float height)
+		{
+			int dense = denseIndex(handle);
+			if (dense < 0) { return; }
+			widths[dense] = width, heights[dense] = height;
+		}
+
+		void rectangle_pool::setColor(rectangle_handle handle, unsigned int color)
+		{
+			int dense = denseIndex(handle);
+			if (dense < 0) { return; }
+			colors[dense] = color;
+		}
+
+		rect rectangle_pool::getBounds(rectangle_handle handle)
+		{
+			int dense = denseIndex(handle);
+			if (dense < 0) { return {0.0f, 0.0f, 0.0f, 0.0f}; }
+			return {xs[dense], ys[dense] - heights[dense], widths[dense], heights[dense]};
+		}
+
+		void rectangle_pool::render(void)
+		{
+			draw_calls = 0;
+			if (count == 0) { return; }
+			front ^= 1;
+			vertex *v = streams[front];
+			for (unsigned int i = 0; i < count; i++) {
+				float left = xs[i], right = xs[i] + widths[i];
+				float top = ys[i] - heights[i], bottom = ys[i];
+				unsigned int color = colors[i];
+				v[0] = {color, left, top, 0.0f};
+				v[1] = {color, right, top, 0.0f};
+				v[2] = {color, right, bottom, 0.0f};
+				v[3] = {color, left, bottom, 0.0f};
+				v += 4;
+			}
+			sceKernelDcacheWritebackRange(streams[front], count * 4 * sizeof(vertex));
+
+			// already in world space
+			sceGumMatrixMode(GU_MODEL);
+			sceGumLoadIdentity();
+			for (unsigned int first = 0; first < count; first += RECTANGLE_POOL_BATCH) {
+				unsigned int n = (count - first < RECTANGLE_POOL_BATCH) ? count - first : RECTANGLE_POOL_BATCH;
+				sceGumDrawArray(GU_TRIANGLES, PSP_PRIMITIVE_VERTICES, n * 6, indices, streams[front] + first * 4);
+				draw_calls++;
+			}
+		}
 	}
 }
\ No newline at end of file
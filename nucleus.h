@@ -10,8 +10,15 @@
 #include <pspdebug.h>
 #include <pspiofilemgr.h>
 
+#include "frame_arena.h"
+#include "generational.h"
+#include "texconv.h"
+#include "vertex_format.h"
+#include "vram.h"
+
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include <cstdio>
 #include <malloc.h>
 
@@ -24,14 +31,21 @@
 #define N_QUAD_VERTICES (4)
 #define N_QUAD_INDICES (6) // 3 triangles for a quad
 
-// rendering function argument macros
-#define PSP_PRIMITIVE_VERTICES (GU_INDEX_16BIT | GU_COLOR_8888 | GU_VERTEX_32BITF | GU_TRANSFORM_3D)
-#define PSP_TEXTURE_VERTICES (GU_INDEX_16BIT | GU_TEXTURE_32BITF | GU_COLOR_8888 | GU_VERTEX_32BITF | GU_TRANSFORM_3D)
-#define PSP_TEXTURE_NORMAL_VERTICES (GU_INDEX_16BIT | GU_COLOR_8888 | GU_TEXTURE_32BITF | GU_VERTEX_32BITF | GU_NORMAL_32BITF | GU_TRANSFORM_3D)
+// rendering function argument macros, vertex bits come from each struct's vertex_format
+#define PSP_PRIMITIVE_VERTICES (GU_INDEX_16BIT | nucleus::vertex::format::vtype | GU_TRANSFORM_3D)
+#define PSP_TEXTURE_VERTICES (GU_INDEX_16BIT | nucleus::tex_vertex::format::vtype | GU_TRANSFORM_3D)
+#define PSP_TEXTURE_NORMAL_VERTICES (GU_INDEX_16BIT | nucleus::tcnp_vertex::format::vtype | GU_TRANSFORM_3D)
+#define PSP_BATCH_VERTICES (nucleus::tex_vertex::format::vtype | GU_TRANSFORM_3D) // non-indexed, 6 vertices per sprite
+#define PSP_SPRITE_VERTICES (nucleus::sprite_vertex::format::vtype | GU_TRANSFORM_2D) // GU_SPRITES, texel uvs and screen coordinates
 
 #define CAMERA_CLAMPING 10.0f
 
 #define GU_LIST_SIZE 262144
+#define SPRITE_BATCH_CAPACITY 1024 // sprites buffered before a forced flush
+#define N_SPRITE_VERTICES (6) // 2 triangles, no index buffer
+#define N_SPRITE_CORNERS (2) // GU_SPRITES only needs the top left and bottom right corners
+#define TEXTURE_MANAGER_SLOTS 64 // textures one texture_manager can hold, slots never move
+#define RECTANGLE_POOL_BATCH 4096 // rectangles per draw, 16 bit indices reach 16384 vertices
 
 namespace nucleus 
 {
@@ -40,27 +54,83 @@ namespace nucleus
 		NUCLEUS_PRIMITIVES, NUCLEUS_TEXTURE2D, NUCLEUS_LIGHTING2D
 	};
 
+	enum class blend_mode
+	{
+		NONE, ALPHA, ADDITIVE
+	};
+
+	enum class texture_format
+	{
+		RGBA8888,
+		RGB5650, RGBA5551, RGBA4444, // converted at load, optionally with ordered dithering
+		T8, T4, // paletted with a 8888 CLUT, quantized when the image has more colors than fit
+		DXT1, DXT3, DXT5, // block compressed at load, baking them with tools/tex_bake or tools/dxt_encode skips that
+		INDEXED // smallest paletted format that holds every color exactly, RGBA8888 past 256 colors
+	};
+
+	enum class primitive_mode
+	{
+		TRIANGLES, // transformed by the Gum matrices, supports rotation
+		SPRITES // axis aligned GU_SPRITES drawn with GU_TRANSFORM_2D
+	};
+
 	struct vertex 
 	{
+		using format = vertex_format<vf::none, vf::color_8888, vf::none, vf::pos_f32>;
 		unsigned int color;
 		float x, y, z;
 	};
 
 	struct tex_vertex
 	{
+		using format = vertex_format<vf::uv_f32, vf::color_8888, vf::none, vf::pos_f32>;
 		float u, v;
 		unsigned int color;
 		float x, y, z;
 	};
 
+	struct sprite_vertex // GU_TRANSFORM_2D: uvs are in texels, positions are screen pixels
+	{
+		using format = vertex_format<vf::uv_u16, vf::color_8888, vf::none, vf::pos_s16>;
+		unsigned short u, v;
+		unsigned int color;
+		short x, y;
+		unsigned short z;
+	};
+
 	struct tcnp_vertex // 'texture, color, normal, position'
 	{
+		using format = vertex_format<vf::uv_f32, vf::color_8888, vf::normal_f32, vf::pos_f32>;
 		float u, v;
 		unsigned int color;
 		float nx, ny, nz;
 		float x, y, z;
 	};
+
+	NUCLEUS_CHECK_VERTEX(vertex);
+	NUCLEUS_CHECK_VERTEX_MEMBER(vertex, position, x);
+	NUCLEUS_CHECK_VERTEX(tex_vertex);
+	NUCLEUS_CHECK_VERTEX_MEMBER(tex_vertex, color, color);
+	NUCLEUS_CHECK_VERTEX_MEMBER(tex_vertex, position, x);
+	NUCLEUS_CHECK_VERTEX(sprite_vertex);
+	NUCLEUS_CHECK_VERTEX_MEMBER(sprite_vertex, color, color);
+	NUCLEUS_CHECK_VERTEX_MEMBER(sprite_vertex, position, x);
+	NUCLEUS_CHECK_VERTEX(tcnp_vertex);
+	NUCLEUS_CHECK_VERTEX_MEMBER(tcnp_vertex, color, color);
+	NUCLEUS_CHECK_VERTEX_MEMBER(tcnp_vertex, normal, nx);
+	NUCLEUS_CHECK_VERTEX_MEMBER(tcnp_vertex, position, x);
 	
+	struct rect // world space, x and y are the top left corner
+	{
+		float x, y, width, height;
+	};
+
+	struct uv_rect // normalized to the texture's padded (power of two) size
+	{
+		float u0, v0, u1, v1;
+	};
+
+	// vertices and indices share one allocation
 	class mesh 
 	{
 	public:
@@ -82,6 +152,8 @@ namespace nucleus
 		virtual void render(void) = 0;
 		virtual ~quad() = default;
 		void changePosition(ScePspFVector3 *position);
+		rect getBounds(void) {return {quad_pos.x, quad_pos.y - height, width, height};} // quads extend up from quad_pos
+		void setUV(const uv_rect &uv); // e.g. a texture_atlas sub-rect
 		T __attribute__((aligned(16)))vertices[N_QUAD_VERTICES];
 	protected:
 		unsigned short __attribute__((aligned(16)))vertex_indices[N_QUAD_INDICES];
@@ -92,7 +164,7 @@ namespace nucleus
 	class texture_quad : public quad<tex_vertex>
 	{
 	public:
-		texture_quad(float twidth, float theight, ScePspFVector3 *pos, unsigned int color);
+		texture_quad(float twidth, float theight, ScePspFVector3 *pos, unsigned int color, const uv_rect *uv = nullptr); // whole texture without uv
 		~texture_quad();
 		void render(void) override;
 	} __attribute__((aligned(16)));
@@ -100,40 +172,340 @@ namespace nucleus
 	class lit_texture_quad : public quad<tcnp_vertex>
 	{
 	public:
-		lit_texture_quad(float twidth, float theight, ScePspFVector3 *pos, unsigned int color);
+		lit_texture_quad(float twidth, float theight, ScePspFVector3 *pos, unsigned int color, const uv_rect *uv = nullptr);
 		~lit_texture_quad();
 		void render(void) override;
 	} __attribute__((aligned(16)));
 
+	class texture_manager;
+	class async_loader;
+
+	// FNV-1a, constexpr so texture names written in game code are hashed by the compiler
+	constexpr unsigned int hashName(const char *name)
+	{
+		unsigned int hash = 2166136261u;
+		while (*name) {
+			hash = (hash ^ (unsigned char)*name++) * 16777619u;
+		}
+		return hash;
+	}
+
+	using texture_handle = generational_handle<struct texture_tag>; // texture_manager slot, goes stale when the texture is removed
+
+	/*
+	* Owns its pixels, CLUT and VRAM block: the destructor (or unloadTexture) frees them. Textures can be moved
+	* but not copied, moving one out of texture_manager's VRAM cache evicts it first.
+	*/
 	class texture
 	{
 	public:
-		void loadTexture(const char *filename, const int vram); // use GU_TRUE for vram parameter
-		texture(const char *filename, const int vram);
+		texture(); // empty, nothing is bound until loadTexture
+		texture(texture &&other);
+		texture &operator=(texture &&other);
+		texture(const texture &) = delete;
+		texture &operator=(const texture &) = delete;
+		/*
+		* use GU_TRUE for vram parameter, .ntx (tools/tex_bake) and .dxt files are read as they are and ignore format.
+		* mipmaps builds a box filtered chain for 8888 and 16 bit formats, used by draws that go through the
+		* matrices (primitive_mode::TRIANGLES, texture_quad, tilemap). GU_TRANSFORM_2D draws only sample level 0.
+		*/
+		void loadTexture(const char *filename, const int vram, texture_format format = texture_format::RGBA8888, bool dither = false, bool mipmaps = false); // unloads first
+		texture(const char *filename, const int vram, texture_format format = texture_format::RGBA8888, bool dither = false, bool mipmaps = false);
 		~texture();
 		void bindTexture(void);
 		int getWidth(void) {return width;}
 		int getHeight(void) {return height;}
 		int getPixelWidth(void) {return pixel_width;}
 		int getPixelHeight(void) {return pixel_height;}
+		int getPsm(void) {return psm;}
+		unsigned int getMipLevels(void) {return mip_levels;}
 		void *getTextureData(void) {return texture_data;}
 		void setTextureData(void* data) {texture_data = data;} // I might not need this...
+		unsigned short getId(void) {return texture_id;}
+		void setId(unsigned short id) {texture_id = id;}
+		bool isInVram(void) {return in_vram;} // pinned in VRAM at load time
+		bool isResident(void) {return in_vram || vram_data != nullptr;} // either pinned or paged in by texture_manager
+		bool isPending(void) {return pending;} // still showing texture_manager's placeholder, sizes are the placeholder's
+		unsigned int getSizeBytes(void); // pixel data of every level, the CLUT stays in RAM
+		void trackVramOwner(void); // call once the texture is at its final address so vram::compact can update it
+		void unloadTexture(void); // gives the pixel memory back to VRAM or the heap
+		static unsigned int getLiveCount(void); // textures holding memory, termGraphics reports any left
+		static unsigned int getLiveBytes(void);
 	private:
-		void *texture_data;
+		friend class texture_manager;
+		void *texture_data; // RAM master copy, or the only copy when loaded straight into VRAM
+		void *vram_data; // copy paged in by texture_manager, nullptr when not resident
+		unsigned int *clut; // 8888 palette for GU_PSM_T4/T8, nullptr otherwise
+		unsigned int clut_entries;
+		texture_manager *cache; // manager that pages this texture, nullptr for standalone textures
+		unsigned int last_bind, last_frame; // LRU bookkeeping for the cache
+		bool in_vram;
+		bool vram_tracked; // trackVramOwner was called, moves re-register the owner
+		bool pending; // texture_data is borrowed from the manager's placeholder until the async load is published
+		unsigned short texture_id; // assigned by texture_manager, 0 for textures it doesn't own
 		int width, height, pixel_width, pixel_height, nr_channels;
+		int psm;
+		unsigned int mip_levels;
+		unsigned int owned_bytes; // counted in the live totals, 0 while nothing is owned
+		void trackAlive(void); // texture_data and clut were just allocated
+		void borrow(const texture &other); // shares other's pixels without owning them, for placeholders
+		unsigned int getLevelSize(unsigned int level);
 		unsigned int pow2(const unsigned int val);
-		void swizzle_fast(u8 *out, const u8 *in, const unsigned int width, const unsigned int height);
-		void copy_texture_data(void *dest, const void *src);
+		void setLayout(const texconv::image_layout &layout);
+		void adoptImage(const texconv::image_layout &layout, void *data, unsigned int *image_clut); // takes ownership of RAM buffers
+		void loadBaked(const char *filename, const int vram); // .ntx and .dxt, no decoding or temporary buffers
+		void *allocatePixels(const int vram); // getSizeBytes() in VRAM or RAM, sets in_vram
+		void logLoad(const char *filename, unsigned int load_start);
+	};
+
+	/*
+	* Shared ownership of a texture_manager texture. Copies add a reference and the last one to go removes the
+	* texture, its memory is freed by the startFrame after the GE has finished the last frame that could use it.
+	* Must not outlive the manager.
+	*/
+	class texture_ref
+	{
+	public:
+		texture_ref();
+		texture_ref(texture_manager *owner, texture_handle texture_slot); // adds a reference
+		texture_ref(const texture_ref &other);
+		texture_ref(texture_ref &&other);
+		texture_ref &operator=(texture_ref other);
+		~texture_ref();
+		texture *get(void) const;
+		texture_handle getHandle(void) const {return handle;}
+		void reset(void);
+	private:
+		texture_manager *manager;
+		texture_handle handle;
+	};
+
+	/*
+	* Named sub-rectangles of one texture, loaded from a .atlas file written by tools/atlas_pack.
+	* Look names up once with getSpriteId and use the id afterwards.
+	*/
+
+	class texture_atlas
+	{
+	public:
+		texture_atlas();
+		// loads the atlas image through manager and keeps a reference to it
+		bool loadAtlas(const char *filename, texture_manager &manager, texture_format format = texture_format::RGBA8888, bool dither = false);
+		int getSpriteId(const char *name); // -1 if the atlas has no sprite with that name
+		uv_rect getUV(int id);
+		uv_rect getUV(const char *name);
+		int getSpriteWidth(int id) {return (id >= 0 && id < (int)entries.size()) ? entries[id].width : 0;} // 0 for unknown ids, like getUV
+		int getSpriteHeight(int id) {return (id >= 0 && id < (int)entries.size()) ? entries[id].height : 0;}
+		unsigned int getSpriteCount(void) {return entries.size();}
+		texture *getTexture(void) {return atlas_texture.get();}
+	private:
+		struct atlas_entry
+		{
+			int x, y, width, height; // pixels
+			uv_rect uv;
+		};
+		std::vector<atlas_entry> entries;
+		std::unordered_map<std::string, int> ids;
+		texture_ref atlas_texture;
+	};
+
+	struct residency_stats // texture_manager VRAM cache, counted for the current frame
+	{
+		unsigned int hits, misses; // binds that found the texture in VRAM / had to upload it
+		unsigned int uploaded_bytes;
+		unsigned int evictions;
+		unsigned int fallbacks; // misses with no room even after evicting (or too big to ever fit), sampled from RAM instead
+		unsigned int resident_bytes, resident_textures; // current totals, not reset per frame
 	};
 
+	/*
+	* Owns textures by file name and treats VRAM as a cache for them. Textures keep their master copy in RAM,
+	* bindTexture pages one into VRAM (copied by the GE in list order) and the least recently bound textures
+	* are evicted when space runs out. Textures bound during the current frame are never evicted, a miss with
+	* nothing left to evict binds the RAM copy.
+	* addTextureAsync returns straight away with a checkerboard placeholder in the texture's place, the file is
+	* loaded on async_loader's worker thread and swapped in by the next publishLoaded, which the game calls once
+	* per frame.
+	* Textures live in a fixed array of slots (a slot map), so their addresses never change. Look one up once
+	* by handle or by hashName(filename) and keep the handle, get() is an index and a generation compare.
+	*/
 	class texture_manager
 	{
 	public:
 		texture_manager();
 		~texture_manager();
-		void addTexture(std::string filename);
-		void removeTexture(std::string filename);
-		std::unordered_map<std::string, texture> textures;
+		// both return the existing handle when filename is already loaded and an invalid one on failure
+		texture_handle addTexture(std::string filename, texture_format format = texture_format::RGBA8888, bool dither = false, bool mipmaps = false);
+		texture_handle addTextureAsync(std::string filename, texture_format format = texture_format::RGBA8888, bool dither = false);
+		unsigned int publishLoaded(void); // swaps in textures the worker has finished, returns how many
+		unsigned int getPendingLoads(void) {return loading.size();}
+		void removeTexture(texture_handle handle); // refused while texture_refs to it exist
+		texture_ref share(texture_handle handle); // hands the texture's lifetime to the returned references
+		void clear(void); // removes every texture, references or not
+		texture *get(texture_handle handle); // nullptr for stale or invalid handles
+		texture_handle find(unsigned int name_hash); // hashName of the filename it was added with
+		texture_handle find(const char *filename) {return find(hashName(filename));}
+		unsigned int getTextureCount(void) {return names.size();}
+		const void *makeResident(texture &tex); // called by bindTexture, returns the address to bind
+		void evict(texture &tex);
+		void evictAll(void);
+		void setVramBudget(unsigned int bytes) {vram_budget = bytes;} // cap on resident bytes, 0 for all free VRAM
+		residency_stats getResidencyStats(void);
+		void logResidency(void);
+	private:
+		friend class texture_ref;
+		struct texture_slot
+		{
+			texture tex;
+			std::string filename; // only read for logs and to catch name hash collisions
+			unsigned int refs; // texture_refs alive
+		};
+		texture_handle claimSlot(const std::string &filename, texture &&tex);
+		void freeSlot(unsigned short index);
+		void retain(texture_handle handle);
+		void release(texture_handle handle);
+		void *detach(texture &tex); // takes tex off the resident list, returns its VRAM copy without releasing it
+		bool evictOldest(void); // false when every resident texture was bound this frame
+		void rollStats(void);
+		void createPlaceholder(void);
+		texture_slot slots[TEXTURE_MANAGER_SLOTS];
+		slot_allocator<texture_handle> ids; // which slots are used, and their generations
+		std::unordered_map<unsigned int, unsigned short> names; // name hash to slot index
+		async_loader *loader; // started by the first addTextureAsync
+		std::unordered_map<unsigned int, texture_handle> loading; // request id to the slot waiting for it
+		texture placeholder;
+		std::vector<texture *> resident;
+		unsigned int vram_budget, resident_bytes, bind_clock, stats_frame;
+		residency_stats stats;
+	};
+
+	struct sprite
+	{
+		float x, y; // bottom left corner, same as texture_quad
+		float width, height;
+		float u0, v0, u1, v1;
+		unsigned int color;
+		texture *sprite_texture;
+		float rotation; // radians around the sprite center, only used by primitive_mode::TRIANGLES
+	};
+
+	class camera2D;
+
+	/*
+	* Collects sprites during the frame and writes them as pre-transformed vertices into display list memory,
+	* issuing one draw per run of sprites that share a texture and primitive mode
+	*/
+	class sprite_batch
+	{
+	public:
+		sprite_batch();
+		void begin(camera2D *camera = nullptr); // camera is needed to place primitive_mode::SPRITES on screen
+		void draw(const sprite &s, primitive_mode mode = primitive_mode::TRIANGLES);
+		void flush(void);
+		void end(void);
+		void setCulling(bool enabled) {culling = enabled;} // on by default when begin() gets a camera
+		unsigned int getDrawCalls(void) {return draw_calls;}
+		unsigned int getSpriteCount(void) {return sprite_count;}
+		unsigned int getVertexBytes(void) {return vertex_bytes;}
+	private:
+		void writeTriangles(void);
+		void writeSprites(void);
+		sprite sprites[SPRITE_BATCH_CAPACITY];
+		unsigned int n_sprites;
+		texture *current_texture;
+		primitive_mode current_mode;
+		float view_x, view_y; // subtracted from sprite positions in primitive_mode::SPRITES
+		float view_zoom; // and then scaled by this
+		rect view_rect;
+		bool culling;
+		unsigned int draw_calls, sprite_count, vertex_bytes; // reset by begin()
+	};
+
+	/*
+	* Persistent GE call list for geometry that rarely changes. Commands and vertex data (sceGuGetMemory)
+	* recorded between beginRecording and endRecording are kept and replayed each frame with call()
+	* until the list is marked dirty and recorded again. sprite_batch vertex data that would overflow the
+	* list is dropped instead of written past it.
+	*/
+	class static_list
+	{
+	public:
+		static_list(unsigned int size_bytes); // every recorded vertex plus the commands between draws
+		~static_list();
+		static_list(const static_list &) = delete; // owns the list buffer
+		static_list &operator=(const static_list &) = delete;
+		bool beginRecording(void); // returns false if the buffer couldn't be allocated
+		bool endRecording(void); // returns false if the geometry didn't fit, nothing is replayed then
+		void call(void);
+		void markDirty(void) {dirty = true;}
+		bool isDirty(void) {return dirty;}
+		unsigned int getUsedBytes(void) {return used_bytes;}
+	private:
+		unsigned int *list;
+		unsigned int list_size, used_bytes;
+		bool dirty;
+	};
+
+	/*
+	* Double buffered frame submission. The CPU builds the next frame into one list while the GE executes the
+	* previous one from the other, each list draws into its own framebuffer and a frame is shown once the
+	* list that drew it has finished, so presentation runs one frame behind the CPU.
+	* Use instead of startFrame/endFrame, not mixed with them.
+	*/
+	class frame_pipeline
+	{
+	public:
+		frame_pipeline(void *list_a, void *list_b);
+		void startFrame(void);
+		void endFrame(void);
+		void drain(void); // waits for every submitted frame, e.g. before termGraphics
+		float getCpuTime(void) {return cpu_time;} // seconds spent building the last frame
+		float getGeTime(void) {return ge_time;} // seconds the GE spent on the last completed frame
+		float getWaitTime(void) {return wait_time;} // seconds the CPU was blocked on the GE in endFrame
+	private:
+		void *lists[2];
+		int list_ids[2]; // GE queue ids, -1 when the list isn't queued
+		unsigned int kick_times[2];
+		unsigned int current;
+		unsigned int build_start;
+		float cpu_time, ge_time, wait_time;
+		void syncList(unsigned int index);
+	};
+
+	/*
+	* Collects sprites and custom draws for a frame, each tagged with a 64 bit sort key, and radix sorts them
+	* so draws are grouped by state within a layer before anything is sent to the GE.
+	* key bits: layer 63-56 | blend 55-52 | render mode 51-49 | primitive mode 48 | texture id 47-32 | depth 31-0
+	*/
+	class render_queue
+	{
+	public:
+		render_queue(unsigned int capacity);
+		static unsigned long long makeKey(unsigned char layer, blend_mode blend, render_mode mode, primitive_mode prim, unsigned short texture_id, float depth);
+		void submit(const sprite &s, unsigned char layer, blend_mode blend = blend_mode::ALPHA, render_mode mode = render_mode::NUCLEUS_TEXTURE2D,
+			primitive_mode prim = primitive_mode::TRIANGLES, float depth = 0.0f);
+		// draw is called with data once the state for the key has been applied and tex (if any) is bound
+		void submit(void (*draw)(void *), void *data, texture *tex, unsigned char layer, blend_mode blend, render_mode mode, float depth = 0.0f);
+		void flush(sprite_batch &batch); // sorts, issues everything through batch and empties the queue
+		unsigned int getStateChanges(void) {return state_changes;}
+		unsigned int getSize(void) {return n_items;}
+	private:
+		struct queue_item
+		{
+			unsigned long long key;
+			unsigned int index; // into sprites, or into commands when the top bit is set
+		};
+		struct draw_command
+		{
+			void (*draw)(void *);
+			void *data;
+			texture *tex;
+		};
+		void sort(void);
+		std::vector<queue_item> items, sort_scratch;
+		std::vector<sprite> sprites;
+		std::vector<draw_command> commands;
+		unsigned int n_items, state_changes;
 	};
 
 	class camera2D 
@@ -144,15 +516,19 @@ namespace nucleus
 		const ScePspFVector3 getCameraPosition(void);
 		void smoothCameraUpdate(float dt);
 		void setCamera(void);
+		rect getVisibleRect(void); // part of the world that ends up on screen
+		void setZoom(float scale) {zoom = scale;} // screen pixels per world unit, about the top left corner (camera_pos)
+		float getZoom(void) {return zoom;}
 	private:
 		ScePspFVector3 camera_pos;
 		ScePspFVector3 camera_target;
+		float zoom;
 	};
 
 	// nucleus (game engine) methods
 	void writeToLog(const char *message);
-	void *getStaticVramBuffer(unsigned int width, unsigned int height, unsigned int psm);
-	void *getStaticVramTexture(unsigned int width, unsigned int height, unsigned int psm);
+	void *getStaticVramBuffer(unsigned int width, unsigned int height, unsigned int psm); // EDRAM relative, pinned
+	void *getStaticVramTexture(unsigned int width, unsigned int height, unsigned int psm); // absolute, nullptr when VRAM is full
 	void initGraphics(void *list);
 	void initMatrices(void);
 	void initLighting(void *list);
@@ -161,8 +537,57 @@ namespace nucleus
 	void endFrame(void);
 	void termGraphics(void);
 	void setRenderMode(render_mode mode, void *list);
+	void applyRenderMode(render_mode mode); // same as setRenderMode but into the current list
+	void applyBlendMode(blend_mode mode);
 	float calculateDeltaTime(u64 &last_time);
 
+	/*
+	* Shadow copy of the GE state. Each setter only writes a command when the value differs from what was last
+	* sent, and counts the commands emitted and skipped. Anything that changes GE state behind its back
+	* (raw sceGu calls, replayed call lists) must call invalidate().
+	*/
+	namespace state
+	{
+		void invalidate(void);
+		void enable(int state);
+		void disable(int state);
+		void blendFunc(int op, int src, int dest, unsigned int srcfix, unsigned int destfix);
+		void texMode(int tpsm, int maxmips, int a2, int swizzle);
+		void texLevelMode(int mode, float bias);
+		void texFunc(int tfx, int tcc);
+		void texFilter(int min, int mag);
+		void texWrap(int u, int v);
+		void texImage(int mipmap, int width, int height, int tbw, const void *tbp);
+		void clutMode(int cpsm, int shift, int mask, int a3);
+		void clutLoad(int num_blocks, const void *cbp); // blocks of 8 entries
+		void texScale(float u, float v); // anything drawing with 8/16 bit uvs changes this, float uvs expect 1.0
+		void material(int mode, int color);
+		void ambient(unsigned int color);
+		void light(int light, int type, int components, const ScePspFVector3 *position);
+		void lightColor(int light, int component, unsigned int color);
+		void resetCounters(void); // called by startFrame
+		unsigned int getEmittedCount(void);
+		unsigned int getSkippedCount(void);
+	}
+
+	/*
+	* Visibility tests against a camera's visible rect, done before any GE command is written.
+	* Counts culled and drawn objects per frame (reset by startFrame).
+	*/
+	namespace cull
+	{
+		inline bool overlaps(const rect &a, const rect &b)
+		{
+			return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+		}
+		bool isVisible(const rect &view, const rect &bounds);
+		// writes the indices of visible bounds to visible (count entries max), returns how many were written
+		unsigned int cullRects(const rect &view, const rect *bounds, unsigned int count, unsigned int *visible);
+		void resetCounters(void);
+		unsigned int getCulledCount(void);
+		unsigned int getDrawnCount(void);
+	}
+
 	namespace primitive
 	{
 		class rectangle
@@ -174,6 +599,7 @@ namespace nucleus
 				void setHeight(float height) {h = height;}
 				float getWidth(void) {return w;}
 				float getHeight(void) {return h;}
+				rect getBounds(void) {return {rectangle_pos.x, rectangle_pos.y - h, w, h};}
 				void render(void);
 			private:
 				mesh rectangle_mesh = mesh(4, 6);
@@ -181,5 +607,45 @@ namespace nucleus
 				float w, h;
 				unsigned int rectangle_color;
 		}__attribute__((aligned(16)));
+
+		using rectangle_handle = generational_handle<struct rectangle_tag>; // rectangle_pool slot
+
+		/*
+		* Any number of untextured rectangles (up to 65535) in one allocation instead of two per rectangle. Each
+		* field is a packed array with the live rectangles at the front, render writes them all into one vertex
+		* stream and draws RECTANGLE_POOL_BATCH at a time with an index buffer they share.
+		* Positions are the bottom left corner like rectangle's, handles survive other rectangles being removed.
+		*/
+		class rectangle_pool
+		{
+		public:
+			rectangle_pool(unsigned int max_rectangles);
+			~rectangle_pool();
+			rectangle_pool(const rectangle_pool &) = delete;
+			rectangle_pool &operator=(const rectangle_pool &) = delete;
+			rectangle_handle add(float width, float height, unsigned int color, ScePspFVector3 position); // invalid when full
+			void remove(rectangle_handle handle);
+			bool isAlive(rectangle_handle handle) {return denseIndex(handle) >= 0;}
+			void changePosition(rectangle_handle handle, ScePspFVector3 *position);
+			void setSize(rectangle_handle handle, float width, float height);
+			void setColor(rectangle_handle handle, unsigned int color);
+			rect getBounds(rectangle_handle handle); // empty for stale handles
+			unsigned int getCount(void) {return count;}
+			unsigned int getCapacity(void) {return capacity;}
+			// once per frame, the stream alternates so the GE can still be reading the previous frame's
+			void render(void);
+			unsigned int getDrawCalls(void) {return draw_calls;} // by the last render
+		private:
+			int denseIndex(rectangle_handle handle); // -1 when stale
+			void *block; // everything below points into it, the slot allocator's storage too
+			float *xs, *ys, *widths, *heights;
+			unsigned int *colors;
+			unsigned short *owners; // packed index to slot
+			unsigned short *slot_dense; // slot to packed index while alive
+			slot_allocator<rectangle_handle> ids;
+			unsigned short *indices; // RECTANGLE_POOL_BATCH quads, relative to the batch's first vertex
+			vertex *streams[2];
+			unsigned int capacity, count, front, draw_calls;
+		};
 	}
 }
\ No newline at end of file
@@ -1,5 +1,9 @@
 #include "nucleus.h"
 #include "callbacks.h"
+#include "ecs.h"
+#include "hierarchy.h"
+#include "texconv.h"
+#include "tilemap.h"
 
 #include <pspdisplay.h>
 #include <pspgu.h>
@@ -7,8 +11,176 @@
 #include <pspkernel.h>
 #include <pspdebug.h>
 
+#include <cmath>
+#include <vector>
+
 #define printf pspDebugScreenPrintf
 
+#define STRESS_SPRITE_COLUMNS 60
+#define STRESS_SPRITE_ROWS 34 // 2040 sprites, a 2x2 screen area of Spelunky sized tiles
+#define STRESS_SPRITE_SIZE 16.0f
+#define STATS_LOG_INTERVAL 120 // frames between stat log writes
+#define STRESS_STATIC_LIST_COMMANDS (16 * 1024) // state and draw commands recorded between the vertex arrays
+
+#define LEVEL_ROOMS_X 4
+#define LEVEL_ROOMS_Y 4
+#define LEVEL_ROOM_WIDTH 10 // Spelunky rooms are 10x8 tiles
+#define LEVEL_ROOM_HEIGHT 8
+#define LEVEL_TILE_SIZE 16
+
+#define BACKGROUND_LAYERS 8 // full screen layers per frame, enough overdraw for texture fetch to dominate
+#define ZOOM_LAYERS 4
+#define ZOOM_TILE_SIZE 512.0f // world units per demo.tga tile, one texel each at 1x
+#define SWIZZLE_BENCH_RUNS 10
+#define RECT_COLUMNS 100 // rectangle scene grid, the rows follow from the count
+#define DEMO_ENTITIES 500
+#define DEMO_ENTITY_SIZE 16.0f
+#define DEMO_CARRIERS 50 // entities with something attached, the first drags a rope and the rest hold an item
+#define DEMO_ROPE_LINKS 8
+
+// hashed by the compiler, texture_manager::find turns them into handles without touching a string
+constexpr unsigned int FONT_TEXTURE = nucleus::hashName("spelunky_font.ntx");
+constexpr unsigned int CIRCLE_TEXTURE = nucleus::hashName("circle.ntx");
+
+enum class demo_scene
+{
+	LIT_QUAD, BATCH_STRESS, TILEMAP, BACKGROUND, ZOOM, RECTANGLES, ENTITIES, N_SCENES
+};
+
+enum class stress_path
+{
+	PER_QUAD, BATCH_TRIANGLES, BATCH_SPRITES, STATIC_LIST, RENDER_QUEUE, ATLAS, N_STRESS_PATHS
+};
+
+// accumulated over STATS_LOG_INTERVAL frames of the stress scene
+struct stress_stats
+{
+	unsigned int frames, draws, vertex_bytes, state_emitted, state_skipped, culled, drawn;
+	unsigned int texture_hits, texture_misses, texture_upload_bytes;
+	float frame_time, build_time, cpu_time, ge_time, wait_time;
+};
+
+static const char *stress_path_names[] = {"per-quad", "sprite_batch triangles", "sprite_batch GU_SPRITES", "static_list replay", "render_queue (interleaved submission)", "sprite_batch GU_SPRITES from one atlas"};
+
+// times texconv::swizzlePadded against padding into a temporary buffer and swizzling that, on a screen sized 8888 image
+static void logSwizzleBenchmark(void)
+{
+	const unsigned int width = PSP_SCR_WIDTH, height = PSP_SCR_HEIGHT, row_bytes = 512 * 4, rows = 512;
+	unsigned char *source = (unsigned char *)memalign(16, width * height * 4);
+	unsigned char *padded = (unsigned char *)memalign(16, row_bytes * rows);
+	unsigned char *out = (unsigned char *)memalign(16, row_bytes * rows);
+	unsigned char *reference = (unsigned char *)memalign(16, row_bytes * rows);
+	if (source == nullptr || padded == nullptr || out == nullptr || reference == nullptr) {
+		free(source), free(padded), free(out), free(reference);
+		return;
+	}
+	for (unsigned int i = 0; i < width * height * 4; i++) {
+		source[i] = (unsigned char)(i * 7);
+	}
+	unsigned int start = sceKernelGetSystemTimeLow();
+	for (int run = 0; run < SWIZZLE_BENCH_RUNS; run++) {
+		memset(padded, 0, row_bytes * rows);
+		for (unsigned int y = 0; y < height; y++) {
+			memcpy(padded + y * row_bytes, source + y * width * 4, width * 4);
+		}
+		nucleus::texconv::swizzle(out, padded, row_bytes, rows);
+	}
+	unsigned int two_pass = sceKernelGetSystemTimeLow() - start;
+	start = sceKernelGetSystemTimeLow();
+	for (int run = 0; run < SWIZZLE_BENCH_RUNS; run++) {
+		nucleus::texconv::swizzlePadded(out, source, width * 4, height, row_bytes, rows);
+	}
+	unsigned int fused = sceKernelGetSystemTimeLow() - start;
+	// same check as tools/swizzle_bench, the fused kernel has to match the two pass output byte for byte
+	nucleus::texconv::swizzle(reference, padded, row_bytes, rows);
+	bool identical = memcmp(reference, out, row_bytes * rows) == 0;
+	char buff[128];
+	sprintf(buff, "swizzle %ux%u 8888: two pass %.3f ms, fused %.3f ms, %s", width, height, two_pass / 1000.0f / SWIZZLE_BENCH_RUNS,
+		fused / 1000.0f / SWIZZLE_BENCH_RUNS, identical ? "bit exact" : "OUTPUT DIFFERS!");
+	nucleus::writeToLog(buff);
+	free(source), free(padded), free(out), free(reference);
+}
+
+/*
+* Heap calls made by the whole program, for the rectangle scene's allocation counts. Only built with make BENCH=1,
+* which links every malloc and memalign (operator new goes through malloc) to these with --wrap. Other builds
+* leave the allocator alone and log heap bytes only.
+*/
+#ifdef NUCLEUS_HEAP_COUNT
+static unsigned int heap_allocations = 0;
+
+static void countAllocation(void)
+{
+	int intr = sceKernelCpuSuspendIntr(); // one core, so the loader thread can't get in while interrupts are off
+	heap_allocations++;
+	sceKernelCpuResumeIntr(intr);
+}
+
+extern "C"
+{
+	void *__real_malloc(size_t size);
+	void *__real_memalign(size_t alignment, size_t size);
+
+	void *__wrap_malloc(size_t size)
+	{
+		countAllocation();
+		return __real_malloc(size);
+	}
+
+	void *__wrap_memalign(size_t alignment, size_t size)
+	{
+		countAllocation();
+		return __real_memalign(alignment, size);
+	}
+}
+#endif
+
+// rectangle scene: the same rectangles as one primitive::rectangle each or all in a rectangle_pool
+struct rectangle_set
+{
+	std::vector<nucleus::primitive::rectangle *> objects;
+	nucleus::primitive::rectangle_pool *pool;
+	unsigned int allocations, heap_bytes; // taken by the last build, allocations only with NUCLEUS_HEAP_COUNT
+};
+
+static void clearRectangles(rectangle_set &set)
+{
+	for (nucleus::primitive::rectangle *r : set.objects) {
+		delete r;
+	}
+	set.objects.clear();
+	delete set.pool;
+	set.pool = nullptr;
+}
+
+static void buildRectangles(rectangle_set &set, unsigned int count, bool pooled)
+{
+	clearRectangles(set);
+	set.objects.reserve(count); // the pointer array isn't part of the comparison
+	unsigned int heap_before = mallinfo().uordblks;
+#ifdef NUCLEUS_HEAP_COUNT
+	unsigned int allocations_before = heap_allocations;
+#endif
+	unsigned int rows = (count + RECT_COLUMNS - 1) / RECT_COLUMNS;
+	float cell_w = (float)PSP_SCR_WIDTH / RECT_COLUMNS, cell_h = (float)PSP_SCR_HEIGHT / rows;
+	if (pooled) {
+		set.pool = new nucleus::primitive::rectangle_pool(count);
+	}
+	for (unsigned int i = 0; i < count; i++) {
+		ScePspFVector3 pos = {(i % RECT_COLUMNS) * cell_w, (i / RECT_COLUMNS + 1) * cell_h, 0.0f};
+		unsigned int color = 0xFF000000 | ((i * 2654435761u) >> 8);
+		if (pooled) {
+			set.pool->add(cell_w * 0.75f, cell_h * 0.75f, color, pos);
+		} else {
+			set.objects.push_back(new nucleus::primitive::rectangle(cell_w * 0.75f, cell_h * 0.75f, color, pos));
+		}
+	}
+	set.heap_bytes = mallinfo().uordblks - heap_before;
+#ifdef NUCLEUS_HEAP_COUNT
+	set.allocations = heap_allocations - allocations_before;
+#endif
+}
+
 // PSP Module Info (necessary to create EBOOT.PBP)
 PSP_MODULE_INFO("Squares", 0, 1, 1);
 PSP_MAIN_THREAD_ATTR(THREAD_ATTR_USER | THREAD_ATTR_VFPU);
@@ -18,11 +190,13 @@ int main()
 	// initialize data
     bool running = true; // used in app loop
     static unsigned int __attribute__((aligned(16))) gu_list[GU_LIST_SIZE]; // used to send commands to the Gu
+    static unsigned int __attribute__((aligned(16))) gu_list_b[GU_LIST_SIZE]; // second list so the CPU can build a frame while the GE draws the last one
 
 	nucleus::setupCallbacks();
 	nucleus::initGraphics(gu_list);
 	nucleus::initLighting(gu_list);
 	nucleus::initMatrices();
+	logSwizzleBenchmark();
 
 	// testing out a 2D camera
 	nucleus::camera2D camera = nucleus::camera2D(0.0f, 0.0f); // have camera looking at the center of the screen
@@ -32,63 +206,455 @@ int main()
 
 	// setting up data for textures
 	nucleus::texture_manager demo_textures = nucleus::texture_manager();
-	demo_textures.addTexture("spelunky_font.png");
-	demo_textures.addTexture("circle.png");
+	// baked offline so loading is a single read each, regenerate with
+	// tools/tex_bake -f indexed spelunky_font.png spelunky_font.ntx (6 colors, T4) and tools/tex_bake -f t8 circle.png circle.ntx
+	demo_textures.addTexture("spelunky_font.ntx");
+	nucleus::texture_handle circle = demo_textures.addTexture("circle.ntx");
+	nucleus::texture *font_texture = demo_textures.get(demo_textures.find(FONT_TEXTURE));
+	nucleus::texture *circle_texture = demo_textures.get(demo_textures.find(CIRCLE_TEXTURE));
+
+	// demo.atlas packs both images above, regenerate with tools/atlas_pack demo spelunky_font.png circle.png
+	nucleus::texture_atlas demo_atlas = nucleus::texture_atlas();
+	demo_atlas.loadAtlas("demo.atlas", demo_textures, nucleus::texture_format::RGBA4444, true); // 512 KB instead of 1 MB of 8888
+	nucleus::vram::logStats();
+
+	// background scene: the same 512x512 image as 8888 and as DXT5, regenerate with tools/dxt_encode demo.tga demo.dxt
+	// the 8888 one is decoded on the loader thread and shows a checkerboard until it's ready. At 1 MB it never fits in the
+	// ~688 KB of VRAM the framebuffers leave, so the DXT5 one stays in RAM as well and both are sampled from RAM
+	nucleus::texture background_dxt = nucleus::texture("demo.dxt", GU_FALSE);
+	nucleus::texture *backgrounds[2] = {demo_textures.get(demo_textures.addTextureAsync("demo.tga")), &background_dxt};
+	unsigned int background = 0, background_frames = 0;
+	float background_ge_time = 0.0f, background_cpu_time = 0.0f;
+
+	// zoom scene: demo.tga tiled under a zoomed out camera, with and without mipmaps, sampled from RAM the same way
+	static const float zoom_levels[] = {1.0f, 0.5f, 0.25f};
+	nucleus::texture zoom_plain = nucleus::texture("demo.tga", GU_FALSE);
+	nucleus::texture zoom_mipmapped = nucleus::texture("demo.tga", GU_FALSE, nucleus::texture_format::RGBA8888, false, true);
+	unsigned int zoom_index = 1, zoom_frames = 0;
+	bool zoom_mipmaps = true;
+	float zoom_ge_time = 0.0f, zoom_cpu_time = 0.0f;
+
+	// rectangle scene, built when it's first shown and whenever cross or circle change it
+	static const unsigned int rect_counts[] = {1000, 10000};
+	rectangle_set rects = {};
+	unsigned int rect_count_index = 0, rect_frames = 0;
+	bool rect_pooled = true, rects_built = false;
+	float rect_render_time = 0.0f, rect_ge_time = 0.0f;
+
+	// entity scene: circles bouncing around the view, stored in an entity_world and drawn through the sprite batch
+	nucleus::entity_world entities = nucleus::entity_world(DEMO_ENTITIES + DEMO_CARRIERS + DEMO_ROPE_LINKS);
+	for (unsigned int i = 0; i < DEMO_ENTITIES; i++) {
+		nucleus::entity e = entities.create();
+		float x = (i * 37) % (PSP_SCR_WIDTH - (int)DEMO_ENTITY_SIZE), y = DEMO_ENTITY_SIZE + (i * 53) % (PSP_SCR_HEIGHT - (int)DEMO_ENTITY_SIZE);
+		entities.add(e, nucleus::transform_component{x, y, 0.0f});
+		entities.add(e, nucleus::velocity_component{(float)((int)(i * 7) % 121 - 60), (float)((int)(i * 13) % 121 - 60)});
+		entities.add(e, nucleus::sprite_component{DEMO_ENTITY_SIZE, DEMO_ENTITY_SIZE, 0.0f, 0.0f, 1.0f, 1.0f, 0xFF000000 | ((i * 2654435761u) >> 8), circle_texture});
+		entities.add(e, nucleus::collider_component{0.0f, 0.0f, DEMO_ENTITY_SIZE, DEMO_ENTITY_SIZE});
+	}
+	// attachments are entities without a velocity or collider, the hierarchy places them relative to their carrier
+	nucleus::transform_hierarchy attachments = nucleus::transform_hierarchy(DEMO_CARRIERS * 2 + DEMO_ROPE_LINKS);
+	std::vector<nucleus::node_handle> carrier_nodes, rope_links;
+	for (unsigned int i = 0; i < DEMO_CARRIERS; i++) {
+		nucleus::transform_component *carrier = entities.get<nucleus::transform_component>(entities.getEntity(i));
+		nucleus::node_handle parent = attachments.add({0, 0}, {carrier->x, carrier->y, 0.0f});
+		carrier_nodes.push_back(parent);
+		for (unsigned int link = 0; link < ((i == 0) ? DEMO_ROPE_LINKS : 1); link++) {
+			nucleus::entity attached = entities.create();
+			entities.add(attached, nucleus::transform_component{});
+			entities.add(attached, nucleus::sprite_component{DEMO_ENTITY_SIZE / 2, DEMO_ENTITY_SIZE / 2, 0.0f, 0.0f, 1.0f, 1.0f, 0xFFFFFFFF, circle_texture});
+			if (i == 0) { // each link hangs below the one before
+				parent = attachments.add(parent, {DEMO_ENTITY_SIZE / 4, DEMO_ENTITY_SIZE * 0.75f, 0.0f}, attached);
+				rope_links.push_back(parent);
+			} else { // held at the top right corner
+				attachments.add(parent, {DEMO_ENTITY_SIZE, -DEMO_ENTITY_SIZE, 0.0f}, attached);
+			}
+		}
+	}
+	unsigned int entity_frames = 0, entity_recomputed = 0;
+	float entity_update_time = 0.0f, entity_cpu_time = 0.0f, entity_ge_time = 0.0f, rope_clock = 0.0f;
 
 	ScePspFVector3 font_pos = {PSP_SCR_WIDTH / 2, PSP_SCR_HEIGHT / 2, 0.0f};
 	ScePspFVector3 circle_pos = {20.0f, 20.0f, 0.0f};
 	ScePspFVector3 lit_circle_pos = {PSP_SCR_WIDTH / 2, PSP_SCR_HEIGHT / 2, 0.0f};
 
-	nucleus::texture_quad font_quad = nucleus::texture_quad(demo_textures.textures.at("spelunky_font.png").getPixelWidth(), demo_textures.textures.at("spelunky_font.png").getPixelHeight(), &font_pos, 0xFFFFFFFF);
+	nucleus::texture_quad font_quad = nucleus::texture_quad(font_texture->getPixelWidth(), font_texture->getPixelHeight(), &font_pos, 0xFFFFFFFF);
 	nucleus::texture_quad circle_quad = nucleus::texture_quad(50.0f, 50.0f, &circle_pos, 0xFFFFFFFF);
 
 	nucleus::lit_texture_quad lit_circle_quad = nucleus::lit_texture_quad(75.0f, 75.0f, &lit_circle_pos, 0xFFFFFFFF);
 
+	// stress scene: the same sprites drawn either one texture_quad at a time or through the sprite batch
+	static nucleus::sprite_batch batch;
+	static nucleus::render_queue queue = nucleus::render_queue(STRESS_SPRITE_COLUMNS * STRESS_SPRITE_ROWS);
+	static nucleus::static_list stress_list(STRESS_SPRITE_COLUMNS * STRESS_SPRITE_ROWS * N_SPRITE_VERTICES *
+		sizeof(nucleus::tex_vertex) + STRESS_STATIC_LIST_COMMANDS);
+	std::vector<nucleus::texture_quad> stress_quads;
+	std::vector<nucleus::sprite> stress_sprites, stress_atlas_sprites;
+	nucleus::uv_rect atlas_font_uv = demo_atlas.getUV("spelunky_font"), atlas_circle_uv = demo_atlas.getUV("circle");
+	stress_quads.reserve(STRESS_SPRITE_COLUMNS * STRESS_SPRITE_ROWS);
+	stress_sprites.reserve(STRESS_SPRITE_COLUMNS * STRESS_SPRITE_ROWS);
+	for (int row = 0; row < STRESS_SPRITE_ROWS; row++) {
+		for (int col = 0; col < STRESS_SPRITE_COLUMNS; col++) {
+			ScePspFVector3 pos = {col * STRESS_SPRITE_SIZE, (row + 1) * STRESS_SPRITE_SIZE, 0.0f};
+			// top half uses the font texture, bottom half the circle, like a tile layer followed by a sprite layer
+			nucleus::texture *tex = (row < STRESS_SPRITE_ROWS / 2) ? font_texture : circle_texture;
+			stress_quads.push_back(nucleus::texture_quad(STRESS_SPRITE_SIZE, STRESS_SPRITE_SIZE, &pos, 0xFFFFFFFF));
+			stress_sprites.push_back({pos.x, pos.y, STRESS_SPRITE_SIZE, STRESS_SPRITE_SIZE, 0.0f, 0.0f, 1.0f, 1.0f, 0xFFFFFFFF, tex});
+			// same sprite out of the atlas, every one of them shares a single texture
+			const nucleus::uv_rect &uv = (row < STRESS_SPRITE_ROWS / 2) ? atlas_font_uv : atlas_circle_uv;
+			stress_atlas_sprites.push_back({pos.x, pos.y, STRESS_SPRITE_SIZE, STRESS_SPRITE_SIZE, uv.u0, uv.v0, uv.u1, uv.v1, 0xFFFFFFFF, demo_atlas.getTexture()});
+		}
+	}
+	std::vector<nucleus::rect> stress_bounds;
+	for (nucleus::texture_quad &q : stress_quads) {
+		stress_bounds.push_back(q.getBounds());
+	}
+	// tilemap scene: a 4x4 room level using the font glyphs as tiles, solid border and a few ledges per room
+	nucleus::tilemap level(LEVEL_ROOMS_X * LEVEL_ROOM_WIDTH, LEVEL_ROOMS_Y * LEVEL_ROOM_HEIGHT, LEVEL_TILE_SIZE,
+		font_texture);
+	for (unsigned int y = 0; y < level.getHeight(); y++) {
+		for (unsigned int x = 0; x < level.getWidth(); x++) {
+			bool border = x == 0 || y == 0 || x == level.getWidth() - 1 || y == level.getHeight() - 1;
+			bool ledge = (y % LEVEL_ROOM_HEIGHT == LEVEL_ROOM_HEIGHT - 1) && ((x + y) % LEVEL_ROOM_WIDTH < 6);
+			if (border || ledge) {
+				level.setTile(x, y, 1 + (x * 7 + y * 3) % 64);
+			}
+		}
+	}
+	unsigned int level_frames = 0;
+
+	sceKernelDcacheWritebackInvalidateAll(); // quads were copied into the vector after their constructors flushed the cache
+	stress_path path = stress_path::BATCH_SPRITES;
+	demo_scene scene = demo_scene::LIT_QUAD;
+	unsigned int last_buttons = 0;
+	stress_stats stats = {};
+
 	static nucleus::render_mode texture_test = nucleus::render_mode::NUCLEUS_TEXTURE2D;
 	static nucleus::render_mode lighting_test = nucleus::render_mode::NUCLEUS_LIGHTING2D;
 	static nucleus::render_mode primitive_test = nucleus::render_mode::NUCLEUS_PRIMITIVES;
 
 	nucleus::setRenderMode(lighting_test, gu_list);	
 
+	nucleus::frame_pipeline pipeline = nucleus::frame_pipeline(gu_list, gu_list_b);
+
 	u64 lastTime;
 	sceRtcGetCurrentTick(&lastTime);
 
 
 	while (running)
 	{
-		nucleus::startFrame(gu_list);
+		pipeline.startFrame();
+		demo_textures.publishLoaded();
 		float dt = nucleus::calculateDeltaTime(lastTime);
 
-		sceGuDisable(GU_DEPTH_TEST);
+		nucleus::state::disable(GU_DEPTH_TEST);
 	
 		// blending
-		sceGuBlendFunc(GU_ADD, GU_SRC_ALPHA, GU_ONE_MINUS_SRC_ALPHA, 0, 0);
-		sceGuEnable(GU_BLEND);
+		nucleus::state::blendFunc(GU_ADD, GU_SRC_ALPHA, GU_ONE_MINUS_SRC_ALPHA, 0, 0);
+		nucleus::state::enable(GU_BLEND);
 
 		// clear background to gray
 		sceGuClearColor(0xFF888888);
 		sceGuClear(GU_COLOR_BUFFER_BIT | GU_DEPTH_BUFFER_BIT | GU_STENCIL_BUFFER_BIT);
 
 		nucleus::readController(ctrlData, &camera);
+		sceCtrlPeekBufferPositive(&ctrlData, 1);
+		unsigned int pressed = ctrlData.Buttons & ~last_buttons;
+		last_buttons = ctrlData.Buttons;
+		if (pressed & PSP_CTRL_SELECT) { // cycle demo scenes
+			scene = (demo_scene)(((int)scene + 1) % (int)demo_scene::N_SCENES);
+			camera.setZoom((scene == demo_scene::ZOOM) ? zoom_levels[zoom_index] : 1.0f);
+		}
+		if (pressed & PSP_CTRL_START) { // defragment VRAM between frames
+			pipeline.drain();
+			unsigned int moved = nucleus::vram::compact();
+			stress_list.markDirty(); // recorded texture addresses may have moved
+			nucleus::state::invalidate();
+			char buff[64];
+			sprintf(buff, "VRAM compaction moved %u blocks", moved);
+			nucleus::writeToLog(buff);
+			nucleus::vram::logStats();
+		}
+		if ((pressed & PSP_CTRL_CROSS) && scene == demo_scene::BACKGROUND) { // switch between the 8888 and DXT5 background
+			background ^= 1;
+			background_frames = 0, background_ge_time = 0.0f, background_cpu_time = 0.0f;
+		} else if ((pressed & (PSP_CTRL_CROSS | PSP_CTRL_CIRCLE)) && scene == demo_scene::RECTANGLES) { // cross toggles the pool, circle the count
+			if (pressed & PSP_CTRL_CROSS) {
+				rect_pooled = !rect_pooled;
+			} else {
+				rect_count_index = (rect_count_index + 1) % (sizeof(rect_counts) / sizeof(rect_counts[0]));
+			}
+			rects_built = false;
+		} else if ((pressed & (PSP_CTRL_CROSS | PSP_CTRL_CIRCLE)) && scene == demo_scene::ZOOM) { // cross toggles mipmaps, circle cycles zoom
+			if (pressed & PSP_CTRL_CROSS) {
+				zoom_mipmaps = !zoom_mipmaps;
+			} else {
+				zoom_index = (zoom_index + 1) % (sizeof(zoom_levels) / sizeof(zoom_levels[0]));
+				camera.setZoom(zoom_levels[zoom_index]);
+			}
+			zoom_frames = 0, zoom_ge_time = 0.0f, zoom_cpu_time = 0.0f;
+		} else if (pressed & PSP_CTRL_CROSS) { // cycle per-quad, batched triangles and batched sprites in the stress scene
+			path = (stress_path)(((int)path + 1) % (int)stress_path::N_STRESS_PATHS);
+			stats = {};
+		}
 
 		// update and set camera
 		camera.smoothCameraUpdate(dt);
 		camera.setCamera();
 
 		// render textured quads
-		// demo_textures.textures.at("spelunky_font.png").bindTexture();
+		// font_texture->bindTexture();
 		// font_quad.render();
 
-		// demo_textures.textures.at("circle.png").bindTexture();
+		// circle_texture->bindTexture();
 		// circle_quad.render();
 
-		// render lit quad
-		demo_textures.textures.at("circle.png").bindTexture();
-		lit_circle_quad.render();
-		
-		nucleus::endFrame();
+		if (scene == demo_scene::LIT_QUAD) {
+			// render lit quad
+			nucleus::state::enable(GU_LIGHTING);
+			demo_textures.get(circle)->bindTexture(); // an index and a generation compare, no string hashing
+			lit_circle_quad.render();
+		} else if (scene == demo_scene::TILEMAP) {
+			nucleus::state::disable(GU_LIGHTING);
+			level.render(&camera);
+			if (++level_frames == STATS_LOG_INTERVAL) {
+				char buff[256];
+				sprintf(buff, "tilemap: %ux%u tiles, %u chunk draws, cpu %.3f ms, ge %.3f ms", level.getWidth(), level.getHeight(),
+					level.getDrawCalls(), 1000.0f * pipeline.getCpuTime(), 1000.0f * pipeline.getGeTime());
+				nucleus::writeToLog(buff);
+				demo_textures.logResidency();
+				level_frames = 0;
+			}
+		} else if (scene == demo_scene::BACKGROUND) {
+			nucleus::state::disable(GU_LIGHTING);
+			nucleus::texture *tex = backgrounds[background];
+			nucleus::rect view = camera.getVisibleRect();
+			float u1 = (float)PSP_SCR_WIDTH / tex->getPixelWidth(), v1 = (float)PSP_SCR_HEIGHT / tex->getPixelHeight();
+			batch.begin(&camera);
+			for (int layer = 0; layer < BACKGROUND_LAYERS; layer++) {
+				batch.draw({view.x, view.y + view.height, view.width, view.height, 0.0f, 0.0f, u1, v1, 0xFFFFFFFF, tex}, nucleus::primitive_mode::SPRITES);
+			}
+			batch.end();
+			background_ge_time += pipeline.getGeTime();
+			background_cpu_time += pipeline.getCpuTime();
+			if (++background_frames == STATS_LOG_INTERVAL) {
+				char buff[256];
+				sprintf(buff, "background: %s, %u bytes in %s, %d layers, ge %.3f ms, cpu %.3f ms", (tex->getPsm() == GU_PSM_8888) ? "8888" : "DXT5",
+					tex->getSizeBytes(), tex->isResident() ? "VRAM" : "RAM", BACKGROUND_LAYERS, 1000.0f * background_ge_time / background_frames,
+					1000.0f * background_cpu_time / background_frames);
+				nucleus::writeToLog(buff);
+				background_frames = 0, background_ge_time = 0.0f, background_cpu_time = 0.0f;
+			}
+		} else if (scene == demo_scene::ZOOM) {
+			// triangles go through the matrices, so the GE can pick a mip level from the zoomed uv slope
+			nucleus::state::disable(GU_LIGHTING);
+			nucleus::texture *tex = zoom_mipmaps ? &zoom_mipmapped : &zoom_plain;
+			nucleus::rect view = camera.getVisibleRect();
+			float first_x = floorf(view.x / ZOOM_TILE_SIZE) * ZOOM_TILE_SIZE, first_y = floorf(view.y / ZOOM_TILE_SIZE) * ZOOM_TILE_SIZE;
+			float u1 = (float)tex->getWidth() / tex->getPixelWidth(), v1 = (float)tex->getHeight() / tex->getPixelHeight();
+			batch.begin(&camera);
+			for (int layer = 0; layer < ZOOM_LAYERS; layer++) {
+				for (float y = first_y; y < view.y + view.height; y += ZOOM_TILE_SIZE) {
+					for (float x = first_x; x < view.x + view.width; x += ZOOM_TILE_SIZE) {
+						batch.draw({x, y + ZOOM_TILE_SIZE, ZOOM_TILE_SIZE, ZOOM_TILE_SIZE, 0.0f, 0.0f, u1, v1, 0xFFFFFFFF, tex}, nucleus::primitive_mode::TRIANGLES);
+					}
+				}
+			}
+			batch.end();
+			zoom_ge_time += pipeline.getGeTime();
+			zoom_cpu_time += pipeline.getCpuTime();
+			if (++zoom_frames == STATS_LOG_INTERVAL) {
+				char buff[256];
+				sprintf(buff, "zoom: %.2fx, 8888 %u levels, %d layers, %u draws, ge %.3f ms, cpu %.3f ms", camera.getZoom(), tex->getMipLevels(),
+					ZOOM_LAYERS, batch.getDrawCalls(), 1000.0f * zoom_ge_time / zoom_frames, 1000.0f * zoom_cpu_time / zoom_frames);
+				nucleus::writeToLog(buff);
+				zoom_frames = 0, zoom_ge_time = 0.0f, zoom_cpu_time = 0.0f;
+			}
+		} else if (scene == demo_scene::RECTANGLES) {
+			if (!rects_built) {
+				pipeline.drain(); // the GE may still be reading the old set's vertices
+				buildRectangles(rects, rect_counts[rect_count_index], rect_pooled);
+				rects_built = true;
+				rect_frames = 0, rect_render_time = 0.0f, rect_ge_time = 0.0f;
+			}
+			nucleus::applyRenderMode(nucleus::render_mode::NUCLEUS_PRIMITIVES);
+			u64 render_start, render_end;
+			sceRtcGetCurrentTick(&render_start);
+			if (rect_pooled) {
+				rects.pool->render();
+			} else {
+				for (nucleus::primitive::rectangle *r : rects.objects) {
+					r->render();
+				}
+			}
+			sceRtcGetCurrentTick(&render_end);
+			nucleus::applyRenderMode(nucleus::render_mode::NUCLEUS_TEXTURE2D);
+			rect_render_time += (render_end - render_start) / (float)sceRtcGetTickResolution();
+			rect_ge_time += pipeline.getGeTime();
+			if (++rect_frames == STATS_LOG_INTERVAL) {
+				char buff[256], allocations[32] = "uncounted (make BENCH=1)";
+#ifdef NUCLEUS_HEAP_COUNT
+				sprintf(allocations, "%u", rects.allocations);
+#endif
+				sprintf(buff, "rectangles: %s, %u rects, %s heap allocations, %u heap bytes, %u draws, render %.3f ms, ge %.3f ms",
+					rect_pooled ? "rectangle_pool" : "one rectangle each", rect_counts[rect_count_index], allocations, rects.heap_bytes,
+					rect_pooled ? rects.pool->getDrawCalls() : rect_counts[rect_count_index], 1000.0f * rect_render_time / rect_frames,
+					1000.0f * rect_ge_time / rect_frames);
+				nucleus::writeToLog(buff);
+				rect_frames = 0, rect_render_time = 0.0f, rect_ge_time = 0.0f;
+			}
+		} else if (scene == demo_scene::ENTITIES) {
+			nucleus::state::disable(GU_LIGHTING);
+			u64 update_start, update_end;
+			sceRtcGetCurrentTick(&update_start);
+			entities.integrate(dt);
+			// colliders have to stay inside the view, turn around the ones heading out of it
+			nucleus::rect view = camera.getVisibleRect();
+			nucleus::component_pool<nucleus::velocity_component> &velocities = entities.pool<nucleus::velocity_component>();
+			entities.each<nucleus::transform_component, nucleus::collider_component>([&velocities, &view](unsigned short index,
+				nucleus::transform_component &t, nucleus::collider_component &c) {
+				nucleus::velocity_component *v = velocities.get(index);
+				if (v == nullptr) { return; }
+				float left = t.x + c.offset_x, top = t.y + c.offset_y - c.height;
+				if ((left < view.x && v->dx < 0.0f) || (left + c.width > view.x + view.width && v->dx > 0.0f)) { v->dx = -v->dx; }
+				if ((top < view.y && v->dy < 0.0f) || (top + c.height > view.y + view.height && v->dy > 0.0f)) { v->dy = -v->dy; }
+			});
+			// carriers moved, the rope swings, everything attached follows in one pass
+			for (unsigned int i = 0; i < DEMO_CARRIERS; i++) {
+				nucleus::transform_component *carrier = entities.get<nucleus::transform_component>(entities.getEntity(i));
+				attachments.setLocal(carrier_nodes[i], {carrier->x, carrier->y, 0.0f});
+			}
+			rope_clock += dt;
+			for (nucleus::node_handle link : rope_links) {
+				attachments.setLocal(link, {DEMO_ENTITY_SIZE / 4, DEMO_ENTITY_SIZE * 0.75f, 0.3f * sinf(rope_clock * 3.0f)});
+			}
+			entity_recomputed += attachments.update();
+			attachments.apply(entities);
+			sceRtcGetCurrentTick(&update_end);
+			batch.begin(&camera);
+			entities.each<nucleus::transform_component, nucleus::sprite_component>([](unsigned short, nucleus::transform_component &t,
+				nucleus::sprite_component &s) {
+				batch.draw({t.x, t.y, s.width, s.height, s.u0, s.v0, s.u1, s.v1, s.color, s.tex, t.rotation}, nucleus::primitive_mode::SPRITES);
+			});
+			batch.end();
+			entity_update_time += (update_end - update_start) / (float)sceRtcGetTickResolution();
+			entity_cpu_time += pipeline.getCpuTime();
+			entity_ge_time += pipeline.getGeTime();
+			if (++entity_frames == STATS_LOG_INTERVAL) {
+				char buff[256];
+				sprintf(buff, "entities: %u, update %.3f ms, %u of %u hierarchy nodes recomputed, %u draws, cpu %.3f ms, ge %.3f ms", entities.getCount(),
+					1000.0f * entity_update_time / entity_frames, entity_recomputed / entity_frames, attachments.getCount(), batch.getDrawCalls(),
+					1000.0f * entity_cpu_time / entity_frames, 1000.0f * entity_ge_time / entity_frames);
+				nucleus::writeToLog(buff);
+				entity_frames = 0, entity_recomputed = 0, entity_update_time = 0.0f, entity_cpu_time = 0.0f, entity_ge_time = 0.0f;
+			}
+		} else {
+			u64 build_start;
+			sceRtcGetCurrentTick(&build_start);
+			nucleus::state::disable(GU_LIGHTING);
+			unsigned int draws = 0, vertex_bytes = 0;
+			if (path == stress_path::STATIC_LIST) {
+				if (stress_list.isDirty()) {
+					// triangles stay in world space, GU_SPRITES would bake in the camera position
+					stress_list.beginRecording();
+					batch.begin();
+					for (const nucleus::sprite &s : stress_sprites) {
+						batch.draw(s, nucleus::primitive_mode::TRIANGLES);
+					}
+					batch.end();
+					stress_list.endRecording();
+				}
+				stress_list.call();
+				draws = 1;
+			} else if (path == stress_path::RENDER_QUEUE) {
+				// submit alternating between the two texture halves, the queue sorts them back into two runs
+				size_t half = stress_sprites.size() / 2;
+				for (size_t i = 0; i < half; i++) {
+					queue.submit(stress_sprites[i], 0);
+					queue.submit(stress_sprites[half + i], 0);
+				}
+				for (size_t i = 2 * half; i < stress_sprites.size(); i++) {
+					queue.submit(stress_sprites[i], 0);
+				}
+				batch.begin(&camera);
+				queue.flush(batch);
+				draws = batch.getDrawCalls();
+				vertex_bytes = batch.getVertexBytes();
+			} else if (path != stress_path::PER_QUAD) {
+				nucleus::primitive_mode mode = (path == stress_path::BATCH_TRIANGLES) ? nucleus::primitive_mode::TRIANGLES : nucleus::primitive_mode::SPRITES;
+				batch.begin(&camera);
+				for (const nucleus::sprite &s : (path == stress_path::ATLAS) ? stress_atlas_sprites : stress_sprites) {
+					batch.draw(s, mode);
+				}
+				batch.end();
+				draws = batch.getDrawCalls();
+				vertex_bytes = batch.getVertexBytes();
+			} else {
+				unsigned int *stress_visible = (unsigned int *)nucleus::frame::allocateScratch(stress_bounds.size() * sizeof(unsigned int));
+				// no scratch left this frame, draw everything unculled rather than skip the frame
+				unsigned int n_visible = (stress_visible != nullptr) ?
+					nucleus::cull::cullRects(camera.getVisibleRect(), stress_bounds.data(), stress_bounds.size(), stress_visible) : stress_bounds.size();
+				nucleus::texture *bound = nullptr;
+				for (unsigned int v = 0; v < n_visible; v++) {
+					unsigned int i = (stress_visible != nullptr) ? stress_visible[v] : v;
+					if (stress_sprites[i].sprite_texture != bound) {
+						bound = stress_sprites[i].sprite_texture;
+						bound->bindTexture();
+					}
+					stress_quads[i].render();
+					draws++;
+				}
+				vertex_bytes = n_visible * (N_QUAD_VERTICES * sizeof(nucleus::tex_vertex) + N_QUAD_INDICES * sizeof(unsigned short));
+			}
+			u64 build_end;
+			sceRtcGetCurrentTick(&build_end);
+
+			stats.frames++;
+			stats.draws += draws;
+			stats.vertex_bytes += vertex_bytes;
+			stats.frame_time += dt;
+			stats.cpu_time += pipeline.getCpuTime();
+			stats.ge_time += pipeline.getGeTime();
+			stats.wait_time += pipeline.getWaitTime();
+			stats.state_emitted += nucleus::state::getEmittedCount();
+			stats.state_skipped += nucleus::state::getSkippedCount();
+			stats.culled += nucleus::cull::getCulledCount();
+			stats.drawn += nucleus::cull::getDrawnCount();
+			nucleus::residency_stats residency = demo_textures.getResidencyStats();
+			stats.texture_hits += residency.hits;
+			stats.texture_misses += residency.misses;
+			stats.texture_upload_bytes += residency.uploaded_bytes;
+			stats.build_time += (build_end - build_start) / (float)sceRtcGetTickResolution();
+			if (stats.frames == STATS_LOG_INTERVAL) {
+				char buff[256];
+				sprintf(buff, "%s: %u sprites, %u draws/frame, %u vertex bytes/frame, build %.3f ms, frame %.3f ms", stress_path_names[(int)path],
+					(unsigned int)stress_sprites.size(), stats.draws / stats.frames, stats.vertex_bytes / stats.frames,
+					1000.0f * stats.build_time / stats.frames, 1000.0f * stats.frame_time / stats.frames);
+				nucleus::writeToLog(buff);
+				sprintf(buff, "  pipeline: cpu %.3f ms, ge %.3f ms, cpu waiting on ge %.3f ms", 1000.0f * stats.cpu_time / stats.frames,
+					1000.0f * stats.ge_time / stats.frames, 1000.0f * stats.wait_time / stats.frames);
+				nucleus::writeToLog(buff);
+				sprintf(buff, "  state commands: %u emitted, %u skipped per frame", stats.state_emitted / stats.frames, stats.state_skipped / stats.frames);
+				nucleus::writeToLog(buff);
+				sprintf(buff, "  culling: %u culled, %u drawn per frame", stats.culled / stats.frames, stats.drawn / stats.frames);
+				nucleus::writeToLog(buff);
+				sprintf(buff, "  texture cache: %u hits, %u misses, %u bytes uploaded per frame, %u bytes resident", stats.texture_hits / stats.frames,
+					stats.texture_misses / stats.frames, stats.texture_upload_bytes / stats.frames, residency.resident_bytes);
+				nucleus::writeToLog(buff);
+				nucleus::frame::logStats();
+				stats = {};
+			}
+		}
+
+		pipeline.endFrame();
 	}
-	nucleus::termGraphics();
+	pipeline.drain();
+	demo_atlas = nucleus::texture_atlas(); // drops its reference, the last one frees the atlas texture
+	demo_textures.clear();
+	clearRectangles(rects);
+	background_dxt.unloadTexture();
+	zoom_plain.unloadTexture();
+	zoom_mipmapped.unloadTexture();
+	nucleus::termGraphics(); // logs anything still alive
 	sceKernelExitGame();
 	return 0;
 }
\ No newline at end of file
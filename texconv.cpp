@@ -0,0 +1,769 @@
+#include "texconv.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace nucleus
+{
+	namespace texconv
+	{
+		static_assert(sizeof(dxt_header) == 16 && sizeof(ntx_header) == 32, "texture file headers are read as raw bytes");
+
+		struct color_count
+		{
+			unsigned int color, count;
+			unsigned int index; // palette entry once quantized
+		};
+
+		unsigned int bitsPerPixel(int format)
+		{
+			switch (format) {
+				case psm::RGBA8888: return 32;
+				case psm::RGB5650: case psm::RGBA5551: case psm::RGBA4444: return 16;
+				case psm::T8: case psm::DXT3: case psm::DXT5: return 8;
+				case psm::T4: case psm::DXT1: return 4;
+			}
+			return 0;
+		}
+
+		static unsigned int pow2(unsigned int val)
+		{
+			unsigned int poweroftwo = 1;
+			while (poweroftwo < val) {
+				poweroftwo <<= 1;
+			}
+			return poweroftwo;
+		}
+
+		void paddedSize(int format, unsigned int width, unsigned int height, unsigned int &pixel_width, unsigned int &pixel_height)
+		{
+			pixel_width = pow2(width);
+			pixel_height = pow2(height);
+			if (format == psm::DXT1 || format == psm::DXT3 || format == psm::DXT5) {
+				pixel_width = std::max(pixel_width, 4u), pixel_height = std::max(pixel_height, 4u);
+			} else if (format != psm::RGBA8888) {
+				pixel_width = std::max(pixel_width, 16 * 8 / bitsPerPixel(format));
+			}
+		}
+
+		void swizzle(unsigned char *out, const unsigned char *in, unsigned int row_bytes, unsigned int height) // from Iridescentrose
+		{
+			unsigned int width_blocks = row_bytes / 16;
+			unsigned int height_blocks = height / 8;
+
+			unsigned int src_pitch = (row_bytes - 16) / 4;
+			unsigned int src_row = row_bytes * 8;
+
+			const unsigned char *ysrc = in;
+			unsigned int *dst = (unsigned int *)out;
+
+			for (unsigned int blocky = 0; blocky < height_blocks; ++blocky) {
+				const unsigned char *xsrc = ysrc;
+				for (unsigned int blockx = 0; blockx < width_blocks; ++blockx) {
+					const unsigned int *src = (const unsigned int *)xsrc;
+					for (unsigned int j = 0; j < 8; ++j) {
+						*(dst++) = *(src++);
+						*(dst++) = *(src++);
+						*(dst++) = *(src++);
+						*(dst++) = *(src++);
+						src += src_pitch;
+					}
+					xsrc += 16;
+				}
+				ysrc += src_row;
+			}
+		}
+
+		// aligned: both pointers are 16 byte aligned
+		static inline void copy16(unsigned char *dst, const unsigned char *src, bool aligned)
+		{
+#if defined(__psp__)
+			if (aligned) { // one VFPU quad load and store, the calling thread needs THREAD_ATTR_VFPU
+				__asm__ volatile("lv.q C000, 0(%1)\n\tsv.q C000, 0(%0)" : : "r"(dst), "r"(src) : "memory");
+				return;
+			}
+			memcpy(dst, src, 16); // lv.q/sv.q fault on unaligned addresses
+#elif defined(__SSE2__)
+			(void)aligned;
+			_mm_storeu_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+#else
+			(void)aligned;
+			memcpy(dst, src, 16);
+#endif
+		}
+
+		void swizzlePadded(unsigned char *out, const unsigned char *in, unsigned int in_row_bytes, unsigned int in_rows,
+			unsigned int row_bytes, unsigned int height)
+		{
+			// each 16 byte block row is either all source, straddles the end of a source row, or all padding
+			// output blocks follow each other, source blocks stay aligned when the rows are a multiple of 16 bytes
+			bool aligned = (((size_t)in | (size_t)out | in_row_bytes) & 15) == 0;
+			for (unsigned int blocky = 0; blocky < height / 8; blocky++) {
+				for (unsigned int x = 0; x < row_bytes; x += 16) {
+					unsigned int source_bytes = (x >= in_row_bytes) ? 0 : std::min(in_row_bytes - x, 16u);
+					for (unsigned int y = blocky * 8; y < blocky * 8 + 8; y++) {
+						const unsigned char *src = in + y * in_row_bytes + x;
+						if (y >= in_rows || source_bytes == 0) {
+							memset(out, 0, 16);
+						} else if (source_bytes == 16) {
+							copy16(out, src, aligned);
+						} else {
+							memcpy(out, src, source_bytes);
+							memset(out + source_bytes, 0, 16 - source_bytes);
+						}
+						out += 16;
+					}
+				}
+			}
+		}
+
+		// fully transparent pixels all become one palette entry whatever their color bits say
+		static unsigned int normalize(unsigned int color)
+		{
+			return (color >> 24) ? color : 0;
+		}
+
+		static unsigned int channel(unsigned int color, unsigned int c)
+		{
+			return (color >> (c * 8)) & 0xFF;
+		}
+
+		// distinct colors sorted by value, with how many pixels use each
+		static std::vector<color_count> histogram(const unsigned int *pixels, unsigned int count)
+		{
+			std::vector<unsigned int> sorted(count);
+			for (unsigned int i = 0; i < count; i++) {
+				sorted[i] = normalize(pixels[i]);
+			}
+			std::sort(sorted.begin(), sorted.end());
+			std::vector<color_count> colors;
+			for (unsigned int i = 0; i < count; i++) {
+				if (colors.empty() || colors.back().color != sorted[i]) {
+					colors.push_back({sorted[i], 0, 0});
+				}
+				colors.back().count++;
+			}
+			return colors;
+		}
+
+		unsigned int countColors(const unsigned int *pixels, unsigned int count, unsigned int limit)
+		{
+			unsigned int n = histogram(pixels, count).size();
+			return (n > limit) ? limit + 1 : n;
+		}
+
+		struct color_box
+		{
+			unsigned int begin, end; // range of the histogram
+			unsigned int widest, range; // channel with the largest spread and that spread
+		};
+
+		static void measure(const std::vector<color_count> &colors, color_box &box)
+		{
+			unsigned int low[4] = {255, 255, 255, 255}, high[4] = {0, 0, 0, 0};
+			for (unsigned int i = box.begin; i < box.end; i++) {
+				for (unsigned int c = 0; c < 4; c++) {
+					low[c] = std::min(low[c], channel(colors[i].color, c));
+					high[c] = std::max(high[c], channel(colors[i].color, c));
+				}
+			}
+			box.widest = 0, box.range = 0;
+			for (unsigned int c = 0; c < 4; c++) {
+				if (high[c] - low[c] > box.range) {
+					box.widest = c, box.range = high[c] - low[c];
+				}
+			}
+		}
+
+		// pixel weighted average of the colors in the box
+		static unsigned int average(const std::vector<color_count> &colors, const color_box &box)
+		{
+			unsigned long long sum[4] = {0, 0, 0, 0}, total = 0;
+			for (unsigned int i = box.begin; i < box.end; i++) {
+				for (unsigned int c = 0; c < 4; c++) {
+					sum[c] += (unsigned long long)channel(colors[i].color, c) * colors[i].count;
+				}
+				total += colors[i].count;
+			}
+			unsigned int color = 0;
+			for (unsigned int c = 0; c < 4; c++) {
+				color |= (unsigned int)((sum[c] + total / 2) / total) << (c * 8);
+			}
+			return color;
+		}
+
+		// splits the histogram range [begin, end) into at most max_colors boxes, returns the palette size
+		static unsigned int medianCut(std::vector<color_count> &colors, unsigned int begin, unsigned int end, unsigned int *palette, unsigned int max_colors)
+		{
+			std::vector<color_box> boxes;
+			boxes.push_back({begin, end, 0, 0});
+			measure(colors, boxes[0]);
+			while (boxes.size() < max_colors) {
+				// split the box with the widest spread along that channel, at the pixel weighted median
+				int split = -1;
+				for (unsigned int b = 0; b < boxes.size(); b++) {
+					if (boxes[b].end - boxes[b].begin > 1 && (split < 0 || boxes[b].range > boxes[split].range)) {
+						split = b;
+					}
+				}
+				if (split < 0 || boxes[split].range == 0) { break; }
+				color_box &box = boxes[split];
+				unsigned int c = box.widest;
+				std::sort(colors.begin() + box.begin, colors.begin() + box.end, [c](const color_count &a, const color_count &b) {
+					return channel(a.color, c) < channel(b.color, c);
+				});
+				unsigned long long total = 0, running = 0;
+				for (unsigned int i = box.begin; i < box.end; i++) {
+					total += colors[i].count;
+				}
+				unsigned int middle = box.begin + 1;
+				for (unsigned int i = box.begin; i < box.end - 1; i++) {
+					running += colors[i].count;
+					middle = i + 1;
+					if (running * 2 >= total) { break; }
+				}
+				color_box upper = {middle, box.end, 0, 0};
+				box.end = middle;
+				measure(colors, box);
+				measure(colors, upper);
+				boxes.push_back(upper);
+			}
+			for (unsigned int b = 0; b < boxes.size(); b++) {
+				palette[b] = average(colors, boxes[b]);
+				for (unsigned int i = boxes[b].begin; i < boxes[b].end; i++) {
+					colors[i].index = b;
+				}
+			}
+			return boxes.size();
+		}
+
+		unsigned int quantize(const unsigned int *pixels, unsigned int count, unsigned int *palette, unsigned int max_colors, unsigned char *indices)
+		{
+			if (count == 0 || max_colors == 0) { return 0; }
+			std::vector<color_count> colors = histogram(pixels, count);
+			unsigned int n_palette = 0;
+			if (colors.size() <= max_colors) {
+				for (color_count &entry : colors) {
+					entry.index = n_palette;
+					palette[n_palette++] = entry.color;
+				}
+			} else {
+				// keep transparency exact, averaging it into dark colors would leave halos around sprites
+				unsigned int begin = 0;
+				if (colors[0].color == 0) {
+					colors[0].index = 0;
+					palette[n_palette++] = 0;
+					begin = 1;
+				}
+				n_palette += medianCut(colors, begin, colors.size(), palette + n_palette, max_colors - n_palette);
+				for (unsigned int i = begin; i < colors.size(); i++) {
+					colors[i].index += begin;
+				}
+				std::sort(colors.begin(), colors.end(), [](const color_count &a, const color_count &b) { return a.color < b.color; });
+			}
+
+			for (unsigned int i = 0; i < count; i++) {
+				unsigned int color = normalize(pixels[i]);
+				auto entry = std::lower_bound(colors.begin(), colors.end(), color, [](const color_count &a, unsigned int value) { return a.color < value; });
+				indices[i] = (unsigned char)entry->index;
+			}
+			return n_palette;
+		}
+
+		static const unsigned char bayer4[4][4] = {
+			{0, 8, 2, 10},
+			{12, 4, 14, 6},
+			{3, 11, 1, 9},
+			{15, 7, 13, 5}
+		};
+
+		// 8 bit channel down to bits, bias is 0..254 of rounding (127 rounds to nearest)
+		static unsigned int reduce(unsigned int value, unsigned int bits, unsigned int bias)
+		{
+			unsigned int max = (1u << bits) - 1;
+			return (value * max + bias) / 255;
+		}
+
+		static unsigned int widen(unsigned int value, unsigned int bits)
+		{
+			unsigned int max = (1u << bits) - 1;
+			return (value * 255 + max / 2) / max;
+		}
+
+		// bits per channel for r, g, b, a
+		static void channelBits(pixel16 format, unsigned int bits[4])
+		{
+			static const unsigned int layouts[3][4] = {{5, 6, 5, 0}, {5, 5, 5, 1}, {4, 4, 4, 4}};
+			for (unsigned int c = 0; c < 4; c++) {
+				bits[c] = layouts[(int)format][c];
+			}
+		}
+
+		void convert16(const unsigned int *pixels, unsigned int width, unsigned int height, pixel16 format, bool dither, unsigned short *out)
+		{
+			unsigned int bits[4];
+			channelBits(format, bits);
+			for (unsigned int y = 0; y < height; y++) {
+				for (unsigned int x = 0; x < width; x++) {
+					unsigned int color = pixels[x + y * width]; // read before out, which may overlap it, is written
+					unsigned int bias = dither ? (bayer4[y & 3][x & 3] * 2 + 1) * 255 / 32 : 127;
+					unsigned int packed = 0, shift = 0;
+					for (unsigned int c = 0; c < 4; c++) {
+						if (bits[c] == 0) { continue; }
+						packed |= reduce(channel(color, c), bits[c], (c == 3) ? 127 : bias) << shift;
+						shift += bits[c];
+					}
+					out[x + y * width] = (unsigned short)packed;
+				}
+			}
+		}
+
+		unsigned int expand16(unsigned short pixel, pixel16 format)
+		{
+			unsigned int bits[4];
+			channelBits(format, bits);
+			unsigned int color = 0, shift = 0;
+			for (unsigned int c = 0; c < 4; c++) {
+				unsigned int value = 0xFF; // formats without alpha are opaque
+				if (bits[c] > 0) {
+					value = widen((pixel >> shift) & ((1u << bits[c]) - 1), bits[c]);
+					shift += bits[c];
+				}
+				color |= value << (c * 8);
+			}
+			return color;
+		}
+
+		void packT4(const unsigned char *indices, unsigned int count, unsigned char *out)
+		{
+			for (unsigned int i = 0; i + 1 < count; i += 2) {
+				out[i / 2] = (indices[i] & 0x0F) | (indices[i + 1] << 4);
+			}
+			if (count & 1) {
+				out[count / 2] = indices[count - 1] & 0x0F;
+			}
+		}
+
+		struct dxt_color_block
+		{
+			unsigned char lines[4]; // 2 bit index per pixel, one byte per row, leftmost pixel in the low bits
+			unsigned short color0, color1;
+		};
+
+		struct dxt3_block
+		{
+			dxt_color_block color;
+			unsigned short alpha[4]; // 4 bits per pixel, one short per row
+		};
+
+		struct dxt5_block
+		{
+			dxt_color_block color;
+			unsigned int alpha_low; // 3 bit indices, 48 bits split over these two
+			unsigned short alpha_high;
+			unsigned char alpha0, alpha1;
+		};
+
+		static_assert(sizeof(dxt_color_block) == 8, "DXT1 blocks are 8 bytes");
+		static_assert(sizeof(dxt3_block) == 16 && sizeof(dxt5_block) == 16, "DXT3/5 blocks are 16 bytes");
+
+		static unsigned int blockBytes(dxt format)
+		{
+			return (format == dxt::DXT1) ? sizeof(dxt_color_block) : sizeof(dxt3_block);
+		}
+
+		unsigned int dxtSize(unsigned int width, unsigned int height, dxt format)
+		{
+			return (width / 4) * (height / 4) * blockBytes(format);
+		}
+
+		static unsigned short pack565(unsigned int color)
+		{
+			return (unsigned short)((channel(color, 0) >> 3) | ((channel(color, 1) >> 2) << 5) | ((channel(color, 2) >> 3) << 11));
+		}
+
+		static unsigned int unpack565(unsigned short color)
+		{
+			unsigned int r = color & 0x1F, g = (color >> 5) & 0x3F, b = color >> 11;
+			return ((r << 3) | (r >> 2)) | (((g << 2) | (g >> 4)) << 8) | (((b << 3) | (b >> 2)) << 16) | 0xFF000000;
+		}
+
+		// weights out of 3 for the first color
+		static unsigned int mix(unsigned int a, unsigned int b, unsigned int weight_a, unsigned int total)
+		{
+			unsigned int color = 0;
+			for (unsigned int c = 0; c < 3; c++) {
+				color |= ((channel(a, c) * weight_a + channel(b, c) * (total - weight_a)) / total) << (c * 8);
+			}
+			return color | 0xFF000000;
+		}
+
+		// the four colors a block's indices select, DXT3/5 always use the four color mode
+		static void colorPalette(const dxt_color_block &block, bool one_bit_alpha, unsigned int palette[4])
+		{
+			palette[0] = unpack565(block.color0);
+			palette[1] = unpack565(block.color1);
+			if (block.color0 > block.color1 || !one_bit_alpha) {
+				palette[2] = mix(palette[0], palette[1], 2, 3);
+				palette[3] = mix(palette[0], palette[1], 1, 3);
+			} else {
+				palette[2] = mix(palette[0], palette[1], 1, 2);
+				palette[3] = 0;
+			}
+		}
+
+		static unsigned int colorDistance(unsigned int a, unsigned int b)
+		{
+			unsigned int sum = 0;
+			for (unsigned int c = 0; c < 3; c++) {
+				int d = (int)channel(a, c) - (int)channel(b, c);
+				sum += d * d;
+			}
+			return sum;
+		}
+
+		// endpoints are the extremes of the block along its principal axis
+		static void encodeColorBlock(const unsigned int pixels[16], bool one_bit_alpha, dxt_color_block &block)
+		{
+			bool transparent[16], any_transparent = false;
+			float mean[3] = {0.0f, 0.0f, 0.0f};
+			unsigned int n_opaque = 0;
+			for (unsigned int i = 0; i < 16; i++) {
+				transparent[i] = one_bit_alpha && channel(pixels[i], 3) < 128;
+				any_transparent |= transparent[i];
+				if (transparent[i]) { continue; }
+				for (unsigned int c = 0; c < 3; c++) {
+					mean[c] += channel(pixels[i], c);
+				}
+				n_opaque++;
+			}
+			if (n_opaque == 0) { // three color mode with every pixel on the transparent index
+				block.color0 = 0, block.color1 = 0;
+				block.lines[0] = block.lines[1] = block.lines[2] = block.lines[3] = 0xFF;
+				return;
+			}
+			float covariance[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}; // rr rg rb gg gb bb
+			for (unsigned int c = 0; c < 3; c++) {
+				mean[c] /= n_opaque;
+			}
+			for (unsigned int i = 0; i < 16; i++) {
+				if (transparent[i]) { continue; }
+				float d[3] = {channel(pixels[i], 0) - mean[0], channel(pixels[i], 1) - mean[1], channel(pixels[i], 2) - mean[2]};
+				covariance[0] += d[0] * d[0], covariance[1] += d[0] * d[1], covariance[2] += d[0] * d[2];
+				covariance[3] += d[1] * d[1], covariance[4] += d[1] * d[2], covariance[5] += d[2] * d[2];
+			}
+			float axis[3] = {1.0f, 1.0f, 1.0f};
+			for (unsigned int iteration = 0; iteration < 8; iteration++) { // power iteration
+				float next[3] = {
+					covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+					covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+					covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]
+				};
+				float length = std::max(std::max(fabsf(next[0]), fabsf(next[1])), fabsf(next[2]));
+				if (length == 0.0f) { break; } // flat block, any axis works
+				axis[0] = next[0] / length, axis[1] = next[1] / length, axis[2] = next[2] / length;
+			}
+			unsigned int low = 0, high = 0;
+			float low_dot = 0.0f, high_dot = 0.0f;
+			bool first = true;
+			for (unsigned int i = 0; i < 16; i++) {
+				if (transparent[i]) { continue; }
+				float dot = channel(pixels[i], 0) * axis[0] + channel(pixels[i], 1) * axis[1] + channel(pixels[i], 2) * axis[2];
+				if (first || dot < low_dot) { low = pixels[i], low_dot = dot; }
+				if (first || dot > high_dot) { high = pixels[i], high_dot = dot; }
+				first = false;
+			}
+
+			block.color0 = pack565(high), block.color1 = pack565(low);
+			// color0 > color1 picks four colors, otherwise three and transparent
+			if ((any_transparent && block.color0 > block.color1) || (!any_transparent && block.color0 < block.color1)) {
+				std::swap(block.color0, block.color1);
+			}
+			unsigned int palette[4];
+			colorPalette(block, one_bit_alpha, palette);
+			unsigned int n_choices = (one_bit_alpha && block.color0 <= block.color1) ? 3 : 4;
+			for (unsigned int y = 0; y < 4; y++) {
+				block.lines[y] = 0;
+				for (unsigned int x = 0; x < 4; x++) {
+					unsigned int i = y * 4 + x, best = 3;
+					if (!transparent[i]) {
+						unsigned int best_distance = ~0u;
+						for (unsigned int p = 0; p < n_choices; p++) {
+							unsigned int distance = colorDistance(pixels[i], palette[p]);
+							if (distance < best_distance) { best = p, best_distance = distance; }
+						}
+					}
+					block.lines[y] |= best << (x * 2);
+				}
+			}
+		}
+
+		static void alphaPalette(unsigned int alpha0, unsigned int alpha1, unsigned int palette[8])
+		{
+			palette[0] = alpha0, palette[1] = alpha1;
+			if (alpha0 > alpha1) {
+				for (unsigned int i = 2; i < 8; i++) {
+					palette[i] = ((8 - i) * alpha0 + (i - 1) * alpha1) / 7;
+				}
+			} else {
+				for (unsigned int i = 2; i < 6; i++) {
+					palette[i] = ((6 - i) * alpha0 + (i - 1) * alpha1) / 5;
+				}
+				palette[6] = 0, palette[7] = 255;
+			}
+		}
+
+		static void encodeAlphaDXT5(const unsigned int pixels[16], dxt5_block &block)
+		{
+			unsigned int low = 255, high = 0;
+			for (unsigned int i = 0; i < 16; i++) {
+				low = std::min(low, channel(pixels[i], 3));
+				high = std::max(high, channel(pixels[i], 3));
+			}
+			block.alpha0 = high, block.alpha1 = low;
+			unsigned int palette[8];
+			alphaPalette(high, low, palette);
+			unsigned long long bits = 0;
+			for (unsigned int i = 0; i < 16; i++) {
+				unsigned int alpha = channel(pixels[i], 3), best = 0;
+				for (unsigned int p = 1; p < 8; p++) {
+					if (abs((int)palette[p] - (int)alpha) < abs((int)palette[best] - (int)alpha)) { best = p; }
+				}
+				bits |= (unsigned long long)best << (i * 3);
+			}
+			block.alpha_low = (unsigned int)bits;
+			block.alpha_high = (unsigned short)(bits >> 32);
+		}
+
+		void encodeDXT(const unsigned int *pixels, unsigned int width, unsigned int height, dxt format, void *out)
+		{
+			unsigned char *dest = (unsigned char *)out;
+			for (unsigned int by = 0; by < height; by += 4) {
+				for (unsigned int bx = 0; bx < width; bx += 4) {
+					unsigned int block_pixels[16];
+					for (unsigned int y = 0; y < 4; y++) {
+						for (unsigned int x = 0; x < 4; x++) {
+							block_pixels[y * 4 + x] = pixels[(bx + x) + (by + y) * width];
+						}
+					}
+					encodeColorBlock(block_pixels, format == dxt::DXT1, *(dxt_color_block *)dest);
+					if (format == dxt::DXT3) {
+						dxt3_block *block = (dxt3_block *)dest;
+						for (unsigned int y = 0; y < 4; y++) {
+							block->alpha[y] = 0;
+							for (unsigned int x = 0; x < 4; x++) {
+								block->alpha[y] |= ((channel(block_pixels[y * 4 + x], 3) * 15 + 127) / 255) << (x * 4);
+							}
+						}
+					} else if (format == dxt::DXT5) {
+						encodeAlphaDXT5(block_pixels, *(dxt5_block *)dest);
+					}
+					dest += blockBytes(format);
+				}
+			}
+		}
+
+		void decodeDXT(const void *blocks, unsigned int width, unsigned int height, dxt format, unsigned int *out)
+		{
+			const unsigned char *src = (const unsigned char *)blocks;
+			for (unsigned int by = 0; by < height; by += 4) {
+				for (unsigned int bx = 0; bx < width; bx += 4) {
+					const dxt_color_block &color = *(const dxt_color_block *)src;
+					unsigned int palette[4], alphas[8];
+					colorPalette(color, format == dxt::DXT1, palette);
+					unsigned long long alpha_bits = 0;
+					if (format == dxt::DXT5) {
+						const dxt5_block &block = *(const dxt5_block *)src;
+						alphaPalette(block.alpha0, block.alpha1, alphas);
+						alpha_bits = block.alpha_low | ((unsigned long long)block.alpha_high << 32);
+					}
+					for (unsigned int y = 0; y < 4; y++) {
+						for (unsigned int x = 0; x < 4; x++) {
+							unsigned int pixel = palette[(color.lines[y] >> (x * 2)) & 3];
+							if (format == dxt::DXT3) {
+								pixel = (pixel & 0xFFFFFF) | ((((const dxt3_block *)src)->alpha[y] >> (x * 4)) & 0xF) * 17 << 24;
+							} else if (format == dxt::DXT5) {
+								pixel = (pixel & 0xFFFFFF) | alphas[(alpha_bits >> ((y * 4 + x) * 3)) & 7] << 24;
+							}
+							out[(bx + x) + (by + y) * width] = pixel;
+						}
+					}
+					src += blockBytes(format);
+				}
+			}
+		}
+
+		image_layout layoutFor(int format, unsigned int width, unsigned int height, bool mipmaps)
+		{
+			image_layout layout;
+			layout.psm = format;
+			layout.width = width, layout.height = height;
+			paddedSize(format, width, height, layout.pixel_width, layout.pixel_height);
+			layout.data_size = layout.pixel_width * layout.pixel_height * bitsPerPixel(format) / 8;
+			layout.clut_entries = (format == psm::T4) ? TEXCONV_T4_COLORS : (format == psm::T8) ? TEXCONV_T8_COLORS : 0;
+			layout.swizzled = format != psm::DXT1 && format != psm::DXT3 && format != psm::DXT5;
+			layout.mip_levels = 1;
+			if (mipmaps && layout.swizzled && layout.clut_entries == 0) {
+				unsigned int bits = bitsPerPixel(format);
+				while (layout.mip_levels < TEXCONV_MAX_MIP_LEVELS && (layout.pixel_width >> layout.mip_levels) * bits >= 16 * 8
+					&& (layout.pixel_height >> layout.mip_levels) >= 8) {
+					layout.data_size += levelSize(layout, layout.mip_levels);
+					layout.mip_levels++;
+				}
+			}
+			return layout;
+		}
+
+		unsigned int levelSize(const image_layout &layout, unsigned int level)
+		{
+			return (layout.pixel_width >> level) * (layout.pixel_height >> level) * bitsPerPixel(layout.psm) / 8;
+		}
+
+		static pixel16 formatPixel16(int format)
+		{
+			return (format == psm::RGB5650) ? pixel16::RGB5650 : (format == psm::RGBA5551) ? pixel16::RGBA5551 : pixel16::RGBA4444;
+		}
+
+		// converts one padded, unswizzled level in place and swizzles it out to data
+		static void convertLevel(unsigned int *pixels, unsigned int width, unsigned int height, const image_layout &layout, bool dither,
+			unsigned char *data, unsigned int *clut)
+		{
+			// every conversion is smaller than the 8888 pixels, so it's done in place before swizzling out of them
+			unsigned int count = width * height;
+			unsigned char *converted = (unsigned char *)pixels;
+			if (layout.psm == psm::T4 || layout.psm == psm::T8) {
+				std::vector<unsigned char> indices(count);
+				memset(clut, 0, layout.clut_entries * 4);
+				quantize(pixels, count, clut, layout.clut_entries, indices.data());
+				if (layout.psm == psm::T4) {
+					packT4(indices.data(), count, converted);
+				} else {
+					memcpy(converted, indices.data(), count);
+				}
+			} else if (layout.psm != psm::RGBA8888) {
+				convert16(pixels, width, height, formatPixel16(layout.psm), dither, (unsigned short *)converted);
+			}
+			swizzle(data, converted, width * bitsPerPixel(layout.psm) / 8, height);
+		}
+
+		int smallestIndexed(const unsigned int *pixels, unsigned int width, unsigned int height)
+		{
+			std::vector<color_count> colors = histogram(pixels, width * height);
+			bool transparent = !colors.empty() && colors[0].color == 0; // sorted, so it would be first
+			// the padding is transparent and needs an entry of its own unless the image already has one
+			unsigned int pixel_width, pixel_height;
+			paddedSize(psm::T4, width, height, pixel_width, pixel_height);
+			unsigned int t4_colors = colors.size() + ((pixel_width * pixel_height > width * height && !transparent) ? 1 : 0);
+			paddedSize(psm::T8, width, height, pixel_width, pixel_height);
+			unsigned int t8_colors = colors.size() + ((pixel_width * pixel_height > width * height && !transparent) ? 1 : 0);
+			return (t4_colors <= TEXCONV_T4_COLORS) ? psm::T4 : (t8_colors <= TEXCONV_T8_COLORS) ? psm::T8 : psm::RGBA8888;
+		}
+
+		void convertImage(const unsigned int *pixels, const image_layout &layout, bool dither, void *data, unsigned int *clut)
+		{
+			if (layout.swizzled && layout.clut_entries == 0 && layout.mip_levels == 1) {
+				// straight from the source rows into padded blocks, 16 bit pixels are converted unpadded first
+				// (transparent padding converts to 0 in every format, so this matches the padded path bit for bit)
+				unsigned int bits = bitsPerPixel(layout.psm);
+				const unsigned char *source = (const unsigned char *)pixels;
+				std::vector<unsigned short> converted;
+				if (layout.psm != psm::RGBA8888) {
+					converted.resize(layout.width * layout.height);
+					convert16(pixels, layout.width, layout.height, formatPixel16(layout.psm), dither, converted.data());
+					source = (const unsigned char *)converted.data();
+				}
+				swizzlePadded((unsigned char *)data, source, layout.width * bits / 8, layout.height, layout.pixel_width * bits / 8, layout.pixel_height);
+				return;
+			}
+			// palettes count the padding as a color and mip levels are filtered from the padded image
+			unsigned int count = layout.pixel_width * layout.pixel_height;
+			std::vector<unsigned int> padded(count, 0); // padding is transparent and quantizes to one entry
+			for (unsigned int y = 0; y < layout.height; y++) {
+				memcpy(&padded[y * layout.pixel_width], pixels + y * layout.width, layout.width * 4);
+			}
+
+			if (!layout.swizzled) { // DXT blocks are already in the order the GE reads them
+				dxt format = (layout.psm == psm::DXT1) ? dxt::DXT1 : (layout.psm == psm::DXT3) ? dxt::DXT3 : dxt::DXT5;
+				encodeDXT(padded.data(), layout.pixel_width, layout.pixel_height, format, data);
+				return;
+			}
+			// each level is filtered from the one above before that one is converted over itself
+			std::vector<unsigned int> next;
+			unsigned char *out = (unsigned char *)data;
+			for (unsigned int level = 0; level < layout.mip_levels; level++) {
+				unsigned int width = layout.pixel_width >> level, height = layout.pixel_height >> level;
+				if (level + 1 < layout.mip_levels) {
+					next.resize((width / 2) * (height / 2));
+					downsample(padded.data(), width, height, next.data());
+				}
+				convertLevel(padded.data(), width, height, layout, dither, out, clut);
+				out += levelSize(layout, level);
+				padded.swap(next);
+			}
+		}
+
+		void downsample(const unsigned int *in, unsigned int width, unsigned int height, unsigned int *out)
+		{
+			for (unsigned int y = 0; y < height / 2; y++) {
+				for (unsigned int x = 0; x < width / 2; x++) {
+					const unsigned int *row = in + 2 * y * width + 2 * x;
+					unsigned int texels[4] = {row[0], row[1], row[width], row[width + 1]};
+					unsigned int alpha = 0, sums[3] = {0, 0, 0};
+					for (unsigned int texel : texels) {
+						unsigned int a = texel >> 24;
+						alpha += a;
+						for (unsigned int c = 0; c < 3; c++) {
+							sums[c] += ((texel >> (c * 8)) & 0xFF) * a;
+						}
+					}
+					unsigned int result = ((alpha + 2) / 4) << 24;
+					if (alpha > 0) {
+						for (unsigned int c = 0; c < 3; c++) {
+							result |= ((sums[c] + alpha / 2) / alpha) << (c * 8);
+						}
+					}
+					out[y * (width / 2) + x] = result;
+				}
+			}
+		}
+
+		bool readHeader(const void *bytes, unsigned int size, image_layout &layout, unsigned int &header_size)
+		{
+			if (size < sizeof(dxt_header)) { return false; }
+			unsigned int magic;
+			memcpy(&magic, bytes, sizeof(magic));
+			if (magic == TEXCONV_DXT_MAGIC) {
+				dxt_header header;
+				memcpy(&header, bytes, sizeof(header));
+				if (header.format > (unsigned short)dxt::DXT5) { return false; }
+				layout = layoutFor(psm::DXT1 + header.format, header.width, header.height);
+				layout.pixel_width = header.pixel_width, layout.pixel_height = header.pixel_height;
+				layout.data_size = dxtSize(header.pixel_width, header.pixel_height, (dxt)header.format);
+				header_size = sizeof(dxt_header);
+			} else if (magic == TEXCONV_NTX_MAGIC && size >= sizeof(ntx_header)) {
+				ntx_header header;
+				memcpy(&header, bytes, sizeof(header));
+				if (header.version != TEXCONV_NTX_VERSION || bitsPerPixel(header.psm) == 0) { return false; }
+				layout = layoutFor(header.psm, header.width, header.height);
+				if (layout.clut_entries != header.clut_entries || layout.swizzled != ((header.flags & TEXCONV_NTX_SWIZZLED) != 0)) { return false; }
+				layout.pixel_width = header.pixel_width, layout.pixel_height = header.pixel_height;
+				layout.data_size = header.data_size;
+				header_size = sizeof(ntx_header);
+			} else {
+				return false;
+			}
+			// the padded size is bound as it is, so it has to be one the GE can sample and hold the image
+			unsigned int pw = layout.pixel_width, ph = layout.pixel_height;
+			if (layout.width == 0 || layout.height == 0 || pw > TEXCONV_MAX_SIZE || ph > TEXCONV_MAX_SIZE || pw != pow2(pw) || ph != pow2(ph) ||
+				pw < layout.width || ph < layout.height) { return false; }
+			return pw * ph * bitsPerPixel(layout.psm) / 8 == layout.data_size;
+		}
+	}
+}
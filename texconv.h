@@ -0,0 +1,135 @@
+#pragma once
+
+/*
+* Pixel format conversions shared by texture loading and the host tools. Nothing in here touches the PSP SDK.
+* Pixels are 32 bit RGBA with red in the low byte, the way stb_image returns them and GU_PSM_8888 stores them.
+*/
+
+#define TEXCONV_T4_COLORS 16
+#define TEXCONV_T8_COLORS 256
+#define TEXCONV_DXT_MAGIC 0x5458444E // "NDXT"
+#define TEXCONV_NTX_MAGIC 0x58544E4E // "NNTX"
+#define TEXCONV_NTX_VERSION 1
+#define TEXCONV_NTX_SWIZZLED 0x1
+#define TEXCONV_MAX_MIP_LEVELS 8 // the GE has texture registers for 8 levels
+#define TEXCONV_MAX_SIZE 512 // widest and tallest texture the GE samples
+
+namespace nucleus
+{
+	namespace texconv
+	{
+		// GE pixel formats, same values as GU_PSM_* so files and the runtime agree without the SDK headers
+		namespace psm
+		{
+			enum : int
+			{
+				RGB5650 = 0, RGBA5551 = 1, RGBA4444 = 2, RGBA8888 = 3, T4 = 4, T8 = 5, DXT1 = 8, DXT3 = 9, DXT5 = 10
+			};
+		}
+
+		enum class pixel16
+		{
+			RGB5650, RGBA5551, RGBA4444 // bit layouts of GU_PSM_5650/5551/4444, red in the low bits
+		};
+
+		enum class dxt
+		{
+			DXT1, DXT3, DXT5 // 4, 8 and 8 bits per pixel, DXT1 has 1 bit alpha, DXT3 explicit 4 bit, DXT5 interpolated
+		};
+
+		// .dxt files written by tools/dxt_encode are this header followed directly by the blocks
+		struct dxt_header
+		{
+			unsigned int magic; // TEXCONV_DXT_MAGIC
+			unsigned short format; // dxt
+			unsigned short reserved;
+			unsigned short width, height; // source image
+			unsigned short pixel_width, pixel_height; // power of two size the blocks cover
+		};
+
+		/*
+		* .ntx files written by tools/tex_bake: this header, the pixel data exactly as the GE samples it (padded,
+		* converted and swizzled unless DXT) and then the 8888 CLUT for T4/T8. 32 bytes keeps the data 16 byte aligned.
+		*/
+		struct ntx_header
+		{
+			unsigned int magic; // TEXCONV_NTX_MAGIC
+			unsigned short version;
+			unsigned short psm;
+			unsigned short width, height; // source image
+			unsigned short pixel_width, pixel_height;
+			unsigned int flags; // TEXCONV_NTX_SWIZZLED
+			unsigned int data_size; // pixel bytes
+			unsigned int clut_entries;
+			unsigned int reserved;
+		};
+
+		unsigned int bitsPerPixel(int format); // psm value, 0 for formats textures can't use
+		// power of two size the texture is stored at, with rows of at least 16 bytes (swizzling and the texture
+		// buffer width need them) or whole 4x4 blocks for DXT
+		void paddedSize(int format, unsigned int width, unsigned int height, unsigned int &pixel_width, unsigned int &pixel_height);
+		// reorders rows of row_bytes (a multiple of 16) into the GE's 16 byte by 8 row blocks, height a multiple of 8
+		void swizzle(unsigned char *out, const unsigned char *in, unsigned int row_bytes, unsigned int height);
+		/*
+		* swizzle and padding in one pass: reads in_rows rows of in_row_bytes (no alignment or padding needed) and
+		* writes the row_bytes by height texture, zero past the source. 128 bit moves through the VFPU (when both
+		* buffers and in_row_bytes are 16 byte aligned) or SSE2.
+		*/
+		void swizzlePadded(unsigned char *out, const unsigned char *in, unsigned int in_row_bytes, unsigned int in_rows,
+			unsigned int row_bytes, unsigned int height);
+
+		// where and how big a texture's data is once converted, shared by the runtime loaders and tools/tex_bake
+		struct image_layout
+		{
+			int psm;
+			unsigned int width, height; // source image
+			unsigned int pixel_width, pixel_height;
+			unsigned int data_size; // pixel bytes, every level
+			unsigned int clut_entries; // 8888 entries, T4/T8 only
+			unsigned int mip_levels; // level n is pixel_width >> n by pixel_height >> n, stored right after level n - 1
+			bool swizzled; // everything but DXT
+		};
+
+		/*
+		* mipmaps adds levels down to the smallest that still swizzles (16 byte rows, 8 rows), for 8888 and the
+		* 16 bit formats only. Paletted and DXT textures always get a single level.
+		*/
+		image_layout layoutFor(int format, unsigned int width, unsigned int height, bool mipmaps = false);
+		unsigned int levelSize(const image_layout &layout, unsigned int level);
+		int smallestIndexed(const unsigned int *pixels, unsigned int width, unsigned int height); // T4/T8 if every color and the padding fit, RGBA8888 otherwise
+		/*
+		* Pads, converts and (unless DXT) swizzles the layout's width * height source pixels into data (data_size
+		* bytes) and clut (clut_entries), box filtering each mip level from the one above it. Uses temporary
+		* buffers the size of the padded image.
+		*/
+		void convertImage(const unsigned int *pixels, const image_layout &layout, bool dither, void *data, unsigned int *clut);
+		// parses a .ntx or .dxt header from the first bytes of a file, the data starts at header_size
+		bool readHeader(const void *bytes, unsigned int size, image_layout &layout, unsigned int &header_size);
+
+		// halves width x height 8888 pixels with a 2x2 box filter, colors are weighted by alpha so transparent texels don't darken edges
+		void downsample(const unsigned int *in, unsigned int width, unsigned int height, unsigned int *out);
+		// counts distinct colors (all fully transparent pixels count as one), stops counting past limit
+		unsigned int countColors(const unsigned int *pixels, unsigned int count, unsigned int limit);
+		/*
+		* Builds a palette of at most max_colors and writes one palette index per pixel, returns the palette size.
+		* Exact when the image has max_colors or fewer distinct colors, median cut otherwise.
+		*/
+		unsigned int quantize(const unsigned int *pixels, unsigned int count, unsigned int *palette, unsigned int max_colors, unsigned char *indices);
+		/*
+		* Converts width * height pixels to a 16 bit format, rounding each channel or, with dither, adding a 4x4
+		* ordered (Bayer) pattern to the color channels first. Alpha is never dithered. out may be pixels itself.
+		*/
+		void convert16(const unsigned int *pixels, unsigned int width, unsigned int height, pixel16 format, bool dither, unsigned short *out);
+		unsigned int expand16(unsigned short pixel, pixel16 format); // back to 8888, for measuring conversion error
+		unsigned int dxtSize(unsigned int width, unsigned int height, dxt format);
+		/*
+		* Encodes width * height pixels (multiples of 4) into GE block order, rows of 4x4 blocks left to right.
+		* The GE's blocks differ from desktop DXT: the color indices come before the two 565 endpoints, the
+		* endpoints have red in the low bits, and the alpha data of DXT3/5 follows the color block.
+		*/
+		void encodeDXT(const unsigned int *pixels, unsigned int width, unsigned int height, dxt format, void *out);
+		void decodeDXT(const void *blocks, unsigned int width, unsigned int height, dxt format, unsigned int *out);
+		// two indices per byte, the left pixel in the low nibble as the GE reads GU_PSM_T4
+		void packT4(const unsigned char *indices, unsigned int count, unsigned char *out);
+	}
+}
@@ -0,0 +1,117 @@
+#include "tilemap.h"
+
+#include <cmath>
+
+namespace nucleus
+{
+	tilemap::tilemap(unsigned int width, unsigned int height, unsigned int size, texture *tileset)
+	{
+		map_width = width, map_height = height;
+		tile_size = size;
+		tile_texture = tileset;
+		draw_calls = 0;
+
+		tiles = (unsigned char *)malloc(map_width * map_height);
+		memset(tiles, TILE_EMPTY, map_width * map_height);
+
+		chunks_x = (map_width + TILEMAP_CHUNK_TILES - 1) / TILEMAP_CHUNK_TILES;
+		chunks_y = (map_height + TILEMAP_CHUNK_TILES - 1) / TILEMAP_CHUNK_TILES;
+		chunks = (chunk *)malloc(chunks_x * chunks_y * sizeof(chunk));
+		unsigned int chunk_bytes = TILEMAP_CHUNK_TILES * TILEMAP_CHUNK_TILES * 2 * sizeof(tile_vertex);
+		for (unsigned int i = 0; i < chunks_x * chunks_y; i++) {
+			chunks[i].vertices[0] = (tile_vertex *)memalign(16, chunk_bytes);
+			chunks[i].vertices[1] = (tile_vertex *)memalign(16, chunk_bytes);
+			chunks[i].n_vertices = 0;
+			chunks[i].front = 0;
+			chunks[i].dirty = true;
+		}
+	}
+
+	tilemap::~tilemap()
+	{
+		for (unsigned int i = 0; i < chunks_x * chunks_y; i++) {
+			free(chunks[i].vertices[0]);
+			free(chunks[i].vertices[1]);
+		}
+		free(chunks);
+		free(tiles);
+	}
+
+	void tilemap::setTile(unsigned int x, unsigned int y, unsigned char id)
+	{
+		if (x >= map_width || y >= map_height) { return; }
+		tiles[x + y * map_width] = id;
+		chunks[(x / TILEMAP_CHUNK_TILES) + (y / TILEMAP_CHUNK_TILES) * chunks_x].dirty = true;
+	}
+
+	unsigned char tilemap::getTile(unsigned int x, unsigned int y)
+	{
+		if (x >= map_width || y >= map_height) { return TILE_EMPTY; }
+		return tiles[x + y * map_width];
+	}
+
+	void tilemap::buildChunk(unsigned int cx, unsigned int cy)
+	{
+		chunk &c = chunks[cx + cy * chunks_x];
+		c.front ^= 1;
+		tile_vertex *v = c.vertices[c.front];
+		unsigned int columns = tile_texture->getWidth() / tile_size;
+		columns = columns == 0 ? 1 : columns;
+
+		// positions are pixels relative to the chunk's top left corner, uvs are texels
+		unsigned int x0 = cx * TILEMAP_CHUNK_TILES, y0 = cy * TILEMAP_CHUNK_TILES;
+		unsigned int n_vertices = 0;
+		for (unsigned int y = y0; y < y0 + TILEMAP_CHUNK_TILES && y < map_height; y++) {
+			for (unsigned int x = x0; x < x0 + TILEMAP_CHUNK_TILES && x < map_width; x++) {
+				unsigned char id = tiles[x + y * map_width];
+				if (id == TILE_EMPTY) { continue; }
+				unsigned short u = ((id - 1) % columns) * tile_size, tv = ((id - 1) / columns) * tile_size;
+				short px = (x - x0) * tile_size, py = (y - y0) * tile_size;
+				v[n_vertices++] = {{u, tv}, {}, {}, {px, py, 0}};
+				v[n_vertices++] = {{(unsigned short)(u + tile_size), (unsigned short)(tv + tile_size)}, {}, {},
+					{(short)(px + tile_size), (short)(py + tile_size), 0}};
+			}
+		}
+		c.n_vertices = n_vertices;
+		c.dirty = false;
+		sceKernelDcacheWritebackRange(v, n_vertices * sizeof(tile_vertex));
+	}
+
+	void tilemap::render(camera2D *camera)
+	{
+		draw_calls = 0;
+		if (tile_texture == nullptr) { return; }
+
+		// only chunks overlapping the view are visited at all
+		rect view = camera->getVisibleRect();
+		float chunk_size = TILEMAP_CHUNK_TILES * tile_size;
+		int first_x = (int)floorf(view.x / chunk_size), last_x = (int)floorf((view.x + view.width) / chunk_size);
+		int first_y = (int)floorf(view.y / chunk_size), last_y = (int)floorf((view.y + view.height) / chunk_size);
+		first_x = first_x < 0 ? 0 : first_x, first_y = first_y < 0 ? 0 : first_y;
+		last_x = last_x >= (int)chunks_x ? chunks_x - 1 : last_x;
+		last_y = last_y >= (int)chunks_y ? chunks_y - 1 : last_y;
+
+		tile_texture->bindTexture();
+		// 16 bit uvs are read as value / 32768, scale them back to texels of the padded texture
+		state::texScale(32768.0f / tile_texture->getPixelWidth(), 32768.0f / tile_texture->getPixelHeight());
+		sceGumMatrixMode(GU_MODEL);
+		for (int cy = first_y; cy <= last_y; cy++) {
+			for (int cx = first_x; cx <= last_x; cx++) {
+				chunk &c = chunks[cx + cy * chunks_x];
+				if (c.dirty) {
+					buildChunk(cx, cy);
+				}
+				if (c.n_vertices == 0) { continue; }
+				// 16 bit positions are read as value / 32768 as well
+				ScePspFVector3 origin = {cx * chunk_size, cy * chunk_size, 0.0f};
+				ScePspFVector3 scale = {32768.0f, 32768.0f, 1.0f};
+				sceGumLoadIdentity();
+				sceGumTranslate(&origin);
+				sceGumScale(&scale);
+				sceGumDrawArray(GU_SPRITES, tile_vertex::format::vtype | GU_TRANSFORM_3D, c.n_vertices, nullptr, c.vertices[c.front]);
+				draw_calls++;
+			}
+		}
+		state::texScale(1.0f, 1.0f);
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "nucleus.h"
+
+#define TILEMAP_CHUNK_TILES 16 // chunk edge length in tiles
+#define TILE_EMPTY 0 // tile ids start at 1, id n is the (n - 1)th tile of the tileset
+
+namespace nucleus
+{
+	// 16 bit positions and uvs, 10 bytes per vertex and 2 vertices (GU_SPRITES) per tile
+	using tile_vertex = gu_vertex<vf::uv_u16, vf::none, vf::none, vf::pos_s16>;
+	NUCLEUS_CHECK_VERTEX(tile_vertex);
+
+	/*
+	* Grid of tile ids split into square chunks. Each chunk keeps prebuilt vertex data for its tiles and is
+	* drawn with one sceGumDrawArray when it overlaps the camera. Chunks rebuild lazily after setTile.
+	*/
+	class tilemap
+	{
+	public:
+		tilemap(unsigned int width, unsigned int height, unsigned int size, texture *tileset); // width and height in tiles, size in pixels
+		~tilemap();
+		tilemap(const tilemap &) = delete; // owns the tiles, the chunks and their vertex buffers
+		tilemap &operator=(const tilemap &) = delete;
+		void setTile(unsigned int x, unsigned int y, unsigned char id);
+		unsigned char getTile(unsigned int x, unsigned int y);
+		void render(camera2D *camera);
+		unsigned int getWidth(void) {return map_width;}
+		unsigned int getHeight(void) {return map_height;}
+		unsigned int getTileSize(void) {return tile_size;}
+		unsigned int getDrawCalls(void) {return draw_calls;} // chunks drawn by the last render
+	private:
+		struct chunk
+		{
+			// two buffers so a rebuild never overwrites vertices the GE may still be reading from the previous frame
+			tile_vertex *vertices[2];
+			unsigned int n_vertices;
+			unsigned int front;
+			bool dirty;
+		};
+		void buildChunk(unsigned int cx, unsigned int cy);
+		unsigned char *tiles;
+		chunk *chunks;
+		unsigned int map_width, map_height, tile_size;
+		unsigned int chunks_x, chunks_y;
+		unsigned int draw_calls;
+		texture *tile_texture;
+	};
+}
@@ -0,0 +1,178 @@
+/*
+* Host side atlas packer, builds an atlas image and a .atlas description from loose images.
+*
+*   g++ -O2 -std=c++17 -I.. atlas_pack.cpp -o atlas_pack
+*   ./atlas_pack [-p padding] [-m max_size] <output name> <image>...
+*
+* Writes <output name>.tga (RLE 32 bit, which stb_image loads on the PSP) and <output name>.atlas.
+* Sprites are named after their file name without directory and extension.
+*/
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define ATLAS_MAX_SIZE 512 // largest texture the GE can sample
+
+struct atlas_image
+{
+	std::string name;
+	int width, height;
+	int x, y;
+	unsigned char *pixels; // RGBA
+};
+
+static std::string spriteName(const std::string &path)
+{
+	size_t slash = path.find_last_of("/\\");
+	std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	return (dot == std::string::npos) ? name : name.substr(0, dot);
+}
+
+// shelf packing, images must be sorted by decreasing height
+static bool pack(std::vector<atlas_image> &images, int width, int height, int padding)
+{
+	int x = 0, y = 0, shelf_height = 0;
+	for (atlas_image &image : images) {
+		int w = image.width + padding, h = image.height + padding;
+		if (x + image.width > width) { // start a new shelf
+			x = 0;
+			y += shelf_height;
+			shelf_height = 0;
+		}
+		if (x + image.width > width || y + image.height > height) {
+			return false;
+		}
+		image.x = x, image.y = y;
+		x += w;
+		shelf_height = std::max(shelf_height, h);
+	}
+	return true;
+}
+
+static void writeTgaRle(const char *filename, const std::vector<unsigned int> &pixels, int width, int height)
+{
+	FILE *f = fopen(filename, "wb");
+	if (!f) {
+		fprintf(stderr, "unable to write %s\n", filename);
+		exit(1);
+	}
+	unsigned char header[18] = {};
+	header[2] = 10; // run length encoded true color
+	header[12] = width & 0xFF, header[13] = width >> 8;
+	header[14] = height & 0xFF, header[15] = height >> 8;
+	header[16] = 32;
+	header[17] = 0x28; // 8 alpha bits, top left origin
+	fwrite(header, 1, sizeof(header), f);
+
+	auto writePixel = [f](unsigned int rgba) {
+		unsigned char bgra[4] = {(unsigned char)(rgba >> 16), (unsigned char)(rgba >> 8), (unsigned char)rgba, (unsigned char)(rgba >> 24)};
+		fwrite(bgra, 1, 4, f);
+	};
+
+	// packets never cross rows, as the format requires
+	for (int y = 0; y < height; y++) {
+		const unsigned int *row = &pixels[y * width];
+		int x = 0;
+		while (x < width) {
+			int run = 1;
+			while (x + run < width && run < 128 && row[x + run] == row[x]) { run++; }
+			if (run > 1) {
+				fputc(0x80 | (run - 1), f);
+				writePixel(row[x]);
+				x += run;
+				continue;
+			}
+			int raw = 1;
+			while (x + raw < width && raw < 128 && (x + raw + 1 >= width || row[x + raw] != row[x + raw + 1])) { raw++; }
+			fputc(raw - 1, f);
+			for (int i = 0; i < raw; i++) {
+				writePixel(row[x + i]);
+			}
+			x += raw;
+		}
+	}
+	fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+	int padding = 1, max_size = ATLAS_MAX_SIZE;
+	int arg = 1;
+	while (arg < argc && argv[arg][0] == '-') {
+		if (!strcmp(argv[arg], "-p") && arg + 1 < argc) {
+			padding = atoi(argv[++arg]);
+		} else if (!strcmp(argv[arg], "-m") && arg + 1 < argc) {
+			max_size = atoi(argv[++arg]);
+		}
+		arg++;
+	}
+	if (argc - arg < 2) {
+		fprintf(stderr, "usage: %s [-p padding] [-m max_size] <output name> <image>...\n", argv[0]);
+		return 1;
+	}
+	std::string output = argv[arg++];
+
+	std::vector<atlas_image> images;
+	for (; arg < argc; arg++) {
+		atlas_image image;
+		int channels;
+		image.pixels = stbi_load(argv[arg], &image.width, &image.height, &channels, STBI_rgb_alpha);
+		if (!image.pixels) {
+			fprintf(stderr, "unable to load %s\n", argv[arg]);
+			return 1;
+		}
+		image.name = spriteName(argv[arg]);
+		image.x = image.y = 0;
+		images.push_back(image);
+	}
+	std::stable_sort(images.begin(), images.end(), [](const atlas_image &a, const atlas_image &b) { return a.height > b.height; });
+
+	// smallest power of two size that fits, growing width and height in turn
+	int width = 16, height = 16;
+	while (!pack(images, width, height, padding)) {
+		if (width > height) {
+			height *= 2;
+		} else {
+			width *= 2;
+		}
+		if (width > max_size || height > max_size) {
+			fprintf(stderr, "images don't fit in a %dx%d atlas\n", max_size, max_size);
+			return 1;
+		}
+	}
+
+	std::vector<unsigned int> pixels(width * height, 0);
+	for (const atlas_image &image : images) {
+		for (int y = 0; y < image.height; y++) {
+			memcpy(&pixels[image.x + (image.y + y) * width], image.pixels + y * image.width * 4, image.width * 4);
+		}
+	}
+	std::string image_file = output + ".tga";
+	writeTgaRle(image_file.c_str(), pixels, width, height);
+
+	std::string atlas_file = output + ".atlas";
+	FILE *f = fopen(atlas_file.c_str(), "w");
+	if (!f) {
+		fprintf(stderr, "unable to write %s\n", atlas_file.c_str());
+		return 1;
+	}
+	size_t slash = image_file.find_last_of("/\\");
+	fprintf(f, "# nucleus atlas, generated by atlas_pack\n");
+	fprintf(f, "image %s %d %d\n", (slash == std::string::npos) ? image_file.c_str() : image_file.c_str() + slash + 1, width, height);
+	for (const atlas_image &image : images) {
+		fprintf(f, "sprite %s %d %d %d %d\n", image.name.c_str(), image.x, image.y, image.width, image.height);
+		stbi_image_free(image.pixels);
+	}
+	fclose(f);
+
+	printf("%s: %dx%d, %u sprites\n", atlas_file.c_str(), width, height, (unsigned int)images.size());
+	return 0;
+}
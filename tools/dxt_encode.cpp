@@ -0,0 +1,84 @@
+/*
+* Host side DXT encoder, converts an image into a .dxt file that nucleus::texture loads without decoding.
+*
+*   g++ -O2 -std=c++17 -I.. dxt_encode.cpp ../texconv.cpp -o dxt_encode
+*   ./dxt_encode [-f dxt1|dxt3|dxt5] <image> <output.dxt>
+*
+* Without -f, images with only opaque and fully transparent pixels become DXT1 and anything else DXT5.
+* The image is padded to a power of two (transparent), the blocks are in the GE's layout (see texconv.h).
+*/
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "texconv.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace nucleus;
+
+static unsigned int pow2(unsigned int val)
+{
+	unsigned int poweroftwo = 4; // DXT works on whole 4x4 blocks
+	while (poweroftwo < val) { poweroftwo <<= 1; }
+	return poweroftwo;
+}
+
+int main(int argc, char **argv)
+{
+	int arg = 1, forced = -1;
+	if (arg + 1 < argc && !strcmp(argv[arg], "-f")) {
+		const char *names[] = {"dxt1", "dxt3", "dxt5"};
+		for (int i = 0; i < 3; i++) {
+			if (!strcmp(argv[arg + 1], names[i])) { forced = i; }
+		}
+		if (forced < 0) {
+			fprintf(stderr, "unknown format %s\n", argv[arg + 1]);
+			return 1;
+		}
+		arg += 2;
+	}
+	if (argc - arg != 2) {
+		fprintf(stderr, "usage: %s [-f dxt1|dxt3|dxt5] <image> <output.dxt>\n", argv[0]);
+		return 1;
+	}
+
+	int width, height, channels;
+	unsigned int *pixels = (unsigned int *)stbi_load(argv[arg], &width, &height, &channels, STBI_rgb_alpha);
+	if (!pixels) {
+		fprintf(stderr, "unable to load %s\n", argv[arg]);
+		return 1;
+	}
+	unsigned int pixel_width = pow2(width), pixel_height = pow2(height);
+	std::vector<unsigned int> padded(pixel_width * pixel_height, 0);
+	bool soft_alpha = false;
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			unsigned int color = pixels[x + y * width], alpha = color >> 24;
+			soft_alpha |= alpha != 0 && alpha != 255;
+			padded[x + y * pixel_width] = color;
+		}
+	}
+	stbi_image_free(pixels);
+
+	texconv::dxt format = (forced >= 0) ? (texconv::dxt)forced : soft_alpha ? texconv::dxt::DXT5 : texconv::dxt::DXT1;
+	std::vector<unsigned char> blocks(texconv::dxtSize(pixel_width, pixel_height, format));
+	texconv::encodeDXT(padded.data(), pixel_width, pixel_height, format, blocks.data());
+
+	texconv::dxt_header header = {TEXCONV_DXT_MAGIC, (unsigned short)format, 0, (unsigned short)width, (unsigned short)height,
+		(unsigned short)pixel_width, (unsigned short)pixel_height};
+	FILE *f = fopen(argv[arg + 1], "wb");
+	if (!f) {
+		fprintf(stderr, "unable to write %s\n", argv[arg + 1]);
+		return 1;
+	}
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(blocks.data(), 1, blocks.size(), f);
+	fclose(f);
+
+	static const char *format_names[] = {"DXT1", "DXT3", "DXT5"};
+	printf("%s: %s %ux%u, %u bytes (%u as 8888)\n", argv[arg + 1], format_names[(int)format], pixel_width, pixel_height,
+		(unsigned int)blocks.size(), pixel_width * pixel_height * 4);
+	return 0;
+}
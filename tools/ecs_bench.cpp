@@ -0,0 +1,373 @@
+/*
+* Host side check and benchmark for nucleus::entity_world, against one heap allocated object per entity with a
+* virtual update (the way texture_quad instances are used today), and for nucleus::transform_hierarchy.
+*
+*   g++ -O2 -std=c++17 -I.. ecs_bench.cpp ../ecs.cpp ../hierarchy.cpp -o ecs_bench
+*   ./ecs_bench [entities] [iterations]
+*
+* Ids, pools and iteration are checked first (stale ids after destroy, components following their entity
+* through swap removal), then hierarchy world transforms against walking every node's parents, through
+* setLocal, setParent and remove. Any failure exits with 1. Timings are per pass over every entity or node.
+*/
+
+#include "ecs.h"
+#include "hierarchy.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace nucleus;
+
+static unsigned int random_state = 12345;
+
+static unsigned int nextRandom(void)
+{
+	random_state = random_state * 1664525 + 1013904223;
+	return random_state;
+}
+
+static float randomFloat(float range)
+{
+	return (nextRandom() >> 8) * (range / 16777216.0f);
+}
+
+template <typename F>
+static double millisPer(unsigned int iterations, F run)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < iterations; i++) {
+		run();
+	}
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+// the shape of a texture_quad: vtable, 16 byte aligned vertex and index arrays and its own position
+struct quad_vertex
+{
+	float u, v;
+	unsigned int color;
+	float x, y, z;
+};
+
+class game_object
+{
+public:
+	virtual ~game_object() {}
+	virtual void update(float dt) = 0;
+	quad_vertex __attribute__((aligned(16))) vertices[4];
+	unsigned short __attribute__((aligned(16))) indices[6];
+	float x, y, dx, dy;
+};
+
+class moving_object : public game_object
+{
+public:
+	void update(float dt) override
+	{
+		x += dx * dt;
+		y += dy * dt;
+	}
+};
+
+// every alive entity's components have to be the ones written for it, wherever swap removal put them
+static unsigned int checkWorld(entity_world &world, const std::vector<entity> &ids, const std::vector<float> &expected_x)
+{
+	unsigned int failures = 0;
+	for (unsigned int i = 0; i < ids.size(); i++) {
+		if (!world.isAlive(ids[i])) { continue; }
+		transform_component *transform = world.get<transform_component>(ids[i]);
+		if (transform == nullptr || transform->x != expected_x[i]) {
+			printf("MISMATCH transform of entity %u\n", ids[i].index);
+			failures++;
+		}
+	}
+	unsigned int pairs = 0;
+	world.each<transform_component, velocity_component>([&pairs](unsigned short, transform_component &, velocity_component &) { pairs++; });
+	if (pairs != world.pool<velocity_component>().size()) {
+		printf("MISMATCH each<transform, velocity> visited %u of %u\n", pairs, world.pool<velocity_component>().size());
+		failures++;
+	}
+	return failures;
+}
+
+// what transform_hierarchy should produce, worked out the slow way for one node
+struct shadow_node
+{
+	node_handle handle;
+	int parent; // into the shadow nodes, -1 for roots
+	node_transform local;
+	bool alive;
+};
+
+static node_transform naiveWorld(const std::vector<shadow_node> &nodes, int i)
+{
+	if (nodes[i].parent < 0) { return nodes[i].local; }
+	node_transform p = naiveWorld(nodes, nodes[i].parent);
+	const node_transform &l = nodes[i].local;
+	float c = cosf(p.rotation), s = sinf(p.rotation);
+	return {p.x + l.x * c - l.y * s, p.y + l.x * s + l.y * c, p.rotation + l.rotation};
+}
+
+static unsigned int checkHierarchy(transform_hierarchy &hierarchy, const std::vector<shadow_node> &nodes, const char *stage)
+{
+	unsigned int failures = 0, alive = 0;
+	for (unsigned int i = 0; i < nodes.size(); i++) {
+		if (hierarchy.isAlive(nodes[i].handle) != nodes[i].alive) {
+			printf("MISMATCH %s: node %u alive %d, expected %d\n", stage, i, hierarchy.isAlive(nodes[i].handle), nodes[i].alive);
+			failures++;
+			continue;
+		}
+		if (!nodes[i].alive) { continue; }
+		alive++;
+		node_transform expected = naiveWorld(nodes, i);
+		const node_transform *world = hierarchy.getWorld(nodes[i].handle);
+		if (fabsf(world->x - expected.x) > 1e-2f || fabsf(world->y - expected.y) > 1e-2f || fabsf(world->rotation - expected.rotation) > 1e-4f) {
+			printf("MISMATCH %s: node %u world (%f, %f, %f), expected (%f, %f, %f)\n", stage, i, world->x, world->y, world->rotation,
+				expected.x, expected.y, expected.rotation);
+			failures++;
+		}
+	}
+	if (alive != hierarchy.getCount()) {
+		printf("MISMATCH %s: %u nodes, expected %u\n", stage, hierarchy.getCount(), alive);
+		failures++;
+	}
+	return failures;
+}
+
+static bool isBelow(const std::vector<shadow_node> &nodes, int node, int ancestor)
+{
+	for (int i = node; i >= 0; i = nodes[i].parent) {
+		if (i == ancestor) { return true; }
+	}
+	return false;
+}
+
+// a tenth of the nodes are roots, the rest hang off a random earlier node
+static void buildHierarchy(transform_hierarchy &hierarchy, std::vector<shadow_node> &nodes, unsigned int n_nodes)
+{
+	for (unsigned int i = 0; i < n_nodes; i++) {
+		int parent = (i % 10 == 0) ? -1 : (int)(nextRandom() % i);
+		node_transform local = {randomFloat(20.0f) - 10.0f, randomFloat(20.0f) - 10.0f, randomFloat(1.0f) - 0.5f};
+		node_handle handle = hierarchy.add((parent >= 0) ? nodes[parent].handle : node_handle{0, 0}, local);
+		nodes.push_back({handle, parent, local, true});
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int n_entities = (argc > 1) ? (unsigned int)atoi(argv[1]) : 10000;
+	unsigned int iterations = (argc > 2) ? (unsigned int)atoi(argv[2]) : 200;
+	if (n_entities == 0 || n_entities > ECS_MAX_ENTITIES) { n_entities = 10000; }
+	if (iterations == 0) { iterations = 1; }
+	unsigned int failures = 0;
+	const float dt = 1.0f / 60.0f;
+
+	// ids and pools
+	{
+		entity_world world(n_entities);
+		std::vector<entity> ids;
+		std::vector<float> expected_x;
+		for (unsigned int i = 0; i < n_entities; i++) {
+			entity e = world.create();
+			ids.push_back(e);
+			expected_x.push_back((float)i);
+			world.add(e, transform_component{(float)i, 0.0f, 0.0f});
+			if (i % 2 == 0) { world.add(e, velocity_component{1.0f, 0.0f}); }
+		}
+		if (world.create().isValid()) {
+			printf("MISMATCH create past capacity returned an entity\n");
+			failures++;
+		}
+		for (unsigned int i = 0; i < n_entities; i += 3) {
+			world.destroy(ids[i]);
+		}
+		for (unsigned int i = 0; i < n_entities; i += 3) {
+			if (world.isAlive(ids[i]) || world.get<transform_component>(ids[i]) != nullptr) {
+				printf("MISMATCH destroyed entity %u still resolves\n", ids[i].index);
+				failures++;
+			}
+		}
+		failures += checkWorld(world, ids, expected_x);
+		// reused indices come back with a new generation, the old ids stay dead
+		for (unsigned int i = 0; i < n_entities; i += 3) {
+			entity e = world.create();
+			if (e.index == ids[i].index && e.generation == ids[i].generation) {
+				printf("MISMATCH index %u reused with the same generation\n", e.index);
+				failures++;
+			}
+			world.add(e, transform_component{-1.0f, 0.0f, 0.0f});
+		}
+		failures += checkWorld(world, ids, expected_x);
+		world.remove<velocity_component>(ids[2]);
+		if (world.get<velocity_component>(ids[2]) != nullptr || world.get<transform_component>(ids[2]) == nullptr) {
+			printf("MISMATCH remove<velocity_component> touched the wrong pool\n");
+			failures++;
+		}
+		failures += checkWorld(world, ids, expected_x);
+	}
+	printf("ecs check: %s\n", failures ? "FAILED" : "ok");
+
+	// hierarchy world transforms
+	unsigned int hierarchy_failures = 0;
+	{
+		transform_hierarchy hierarchy(n_entities);
+		std::vector<shadow_node> nodes;
+		buildHierarchy(hierarchy, nodes, n_entities);
+		hierarchy.update();
+		hierarchy_failures += checkHierarchy(hierarchy, nodes, "build");
+
+		for (unsigned int i = 0; i < n_entities / 100 + 1; i++) {
+			unsigned int node = nextRandom() % nodes.size();
+			nodes[node].local.rotation += 0.25f;
+			hierarchy.setLocal(nodes[node].handle, nodes[node].local);
+		}
+		hierarchy.update();
+		hierarchy_failures += checkHierarchy(hierarchy, nodes, "setLocal");
+		if (hierarchy.update() != 0) {
+			printf("MISMATCH update with nothing dirty recomputed nodes\n");
+			hierarchy_failures++;
+		}
+
+		// a node can't be its own parent, the random moves below also try putting nodes under their descendants
+		if (hierarchy.setParent(nodes[0].handle, nodes[0].handle)) {
+			printf("MISMATCH setParent accepted the node as its own parent\n");
+			hierarchy_failures++;
+		}
+		for (unsigned int i = 0; i < n_entities / 50 + 1; i++) {
+			int node = nextRandom() % nodes.size(), parent = nextRandom() % nodes.size();
+			bool accepted = hierarchy.setParent(nodes[node].handle, nodes[parent].handle);
+			if (accepted == isBelow(nodes, parent, node)) {
+				printf("MISMATCH setParent(%d, %d) returned %d\n", node, parent, accepted);
+				hierarchy_failures++;
+			}
+			if (accepted) { nodes[node].parent = parent; }
+		}
+		hierarchy.update();
+		hierarchy_failures += checkHierarchy(hierarchy, nodes, "setParent");
+
+		for (unsigned int i = 0; i < n_entities / 200 + 1; i++) {
+			int node = nextRandom() % nodes.size();
+			if (!nodes[node].alive) { continue; }
+			hierarchy.remove(nodes[node].handle);
+			for (unsigned int j = 0; j < nodes.size(); j++) {
+				if (nodes[j].alive && isBelow(nodes, j, node)) { nodes[j].alive = false; }
+			}
+		}
+		// the survivors still have to come out right once something changes
+		for (shadow_node &node : nodes) {
+			if (node.alive && node.parent < 0) {
+				node.local.x += 1.0f;
+				hierarchy.setLocal(node.handle, node.local);
+			}
+		}
+		hierarchy.update();
+		hierarchy_failures += checkHierarchy(hierarchy, nodes, "remove");
+
+		// apply writes into the entities the nodes were added with
+		entity_world targets(4);
+		entity root_entity = targets.create(), child_entity = targets.create();
+		targets.add(root_entity, transform_component{});
+		targets.add(child_entity, transform_component{});
+		transform_hierarchy pair(2);
+		node_handle root = pair.add({0, 0}, {100.0f, 50.0f, 1.5707964f}, root_entity);
+		pair.add(root, {10.0f, 0.0f, 0.0f}, child_entity);
+		pair.update();
+		pair.apply(targets);
+		transform_component *child = targets.get<transform_component>(child_entity);
+		if (fabsf(child->x - 100.0f) > 1e-3f || fabsf(child->y - 60.0f) > 1e-3f || targets.get<transform_component>(root_entity)->x != 100.0f) {
+			printf("MISMATCH apply wrote (%f, %f) for the child\n", child->x, child->y);
+			hierarchy_failures++;
+		}
+	}
+	printf("hierarchy check: %s\n", hierarchy_failures ? "FAILED" : "ok");
+	failures += hierarchy_failures;
+
+	// every entity moves, half are drawn and a quarter collide
+	entity_world world(n_entities);
+	std::vector<entity> ids;
+	double create_ms = millisPer(1, [&]() {
+		for (unsigned int i = 0; i < n_entities; i++) {
+			entity e = world.create();
+			ids.push_back(e);
+			world.add(e, transform_component{randomFloat(480.0f), randomFloat(272.0f), 0.0f});
+			world.add(e, velocity_component{randomFloat(60.0f) - 30.0f, randomFloat(60.0f) - 30.0f});
+			if (i % 2 == 0) { world.add(e, sprite_component{16.0f, 16.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0xFFFFFFFF, nullptr}); }
+			if (i % 4 == 0) { world.add(e, collider_component{0.0f, 0.0f, 16.0f, 16.0f}); }
+		}
+	});
+	std::vector<game_object *> objects;
+	double object_create_ms = millisPer(1, [&]() {
+		for (unsigned int i = 0; i < n_entities; i++) {
+			game_object *object = new moving_object();
+			object->x = randomFloat(480.0f), object->y = randomFloat(272.0f);
+			object->dx = randomFloat(60.0f) - 30.0f, object->dy = randomFloat(60.0f) - 30.0f;
+			objects.push_back(object);
+		}
+	});
+
+	double integrate_ms = millisPer(iterations, [&]() { world.integrate(dt); });
+	double object_update_ms = millisPer(iterations, [&]() {
+		for (game_object *object : objects) {
+			object->update(dt);
+		}
+	});
+
+	// what feeding sprite_batch walks: every drawn entity's transform and sprite
+	float checksum = 0.0f;
+	double sprites_ms = millisPer(iterations, [&]() {
+		world.each<transform_component, sprite_component>([&checksum](unsigned short, transform_component &t, sprite_component &s) {
+			checksum += t.x + s.width;
+		});
+	});
+
+	// a third of the entities die and are replaced, as bullets and particles would
+	double churn_ms = millisPer(iterations, [&]() {
+		for (unsigned int i = 0; i < n_entities; i += 3) {
+			world.destroy(ids[i]);
+			ids[i] = world.create();
+			world.add(ids[i], transform_component{0.0f, 0.0f, 0.0f});
+			world.add(ids[i], velocity_component{1.0f, 1.0f});
+		}
+	});
+
+	// hierarchy updates: nothing changed, 1% of nodes moved, every root moved (so every node)
+	transform_hierarchy hierarchy(n_entities);
+	std::vector<shadow_node> nodes;
+	buildHierarchy(hierarchy, nodes, n_entities);
+	hierarchy.update();
+	double idle_ms = millisPer(iterations, [&]() { hierarchy.update(); });
+	unsigned int partial_nodes = 0;
+	double partial_ms = millisPer(iterations, [&]() {
+		for (unsigned int i = 0; i < n_entities / 100; i++) {
+			hierarchy.setLocal(nodes[(i * 97) % nodes.size()].handle, nodes[(i * 97) % nodes.size()].local);
+		}
+		partial_nodes = hierarchy.update();
+	});
+	double full_ms = millisPer(iterations, [&]() {
+		for (unsigned int i = 0; i < nodes.size(); i += 10) {
+			hierarchy.setLocal(nodes[i].handle, nodes[i].local);
+		}
+		hierarchy.update();
+	});
+
+	printf("%u entities, %u iterations (checksum %.0f)\n", n_entities, iterations, checksum);
+	printf("%-34s %10s\n", "", "ms");
+	printf("%-34s %10.3f\n", "create, entity_world", create_ms);
+	printf("%-34s %10.3f\n", "create, object per entity", object_create_ms);
+	printf("%-34s %10.4f\n", "move, entity_world::integrate", integrate_ms);
+	printf("%-34s %10.4f\n", "move, virtual update per object", object_update_ms);
+	printf("%-34s %10.4f\n", "each<transform, sprite>", sprites_ms);
+	printf("%-34s %10.4f\n", "destroy and create a third", churn_ms);
+	printf("%-34s %10.4f\n", "hierarchy update, nothing dirty", idle_ms);
+	char label[64];
+	snprintf(label, sizeof(label), "hierarchy update, %u recomputed", partial_nodes);
+	printf("%-34s %10.4f\n", label, partial_ms);
+	printf("%-34s %10.4f\n", "hierarchy update, every node", full_ms);
+	for (game_object *object : objects) {
+		delete object;
+	}
+	return failures ? 1 : 0;
+}
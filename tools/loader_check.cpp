@@ -0,0 +1,198 @@
+/*
+* Host side check for nucleus::async_loader. Requests a set of files from the worker, polls until every one has
+* come back and compares each result against what it should be:
+*   .png  - stb_image plus texconv::convertImage on this thread, layout and bytes must match
+*   .ntx  - the file's own header and payload, read straight from disk
+*   missing file - ok is false and no buffers are handed back
+*
+*   g++ -O2 -std=c++17 -DNUCLEUS_HOST -I.. loader_check.cpp ../async_loader.cpp ../texconv.cpp -pthread -o loader_check
+*   ./loader_check [asset directory, .. by default]
+*
+* Any failure exits with 1.
+*/
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "async_loader.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace nucleus;
+
+#define LOADER_CHECK_TIMEOUT_MS 10000
+
+struct expected_image
+{
+	bool ok;
+	texconv::image_layout layout;
+	std::vector<unsigned char> data, clut;
+};
+
+static std::vector<unsigned char> readAll(const std::string &filename)
+{
+	std::vector<unsigned char> bytes;
+	FILE *file = fopen(filename.c_str(), "rb");
+	if (file == nullptr) { return bytes; }
+	fseek(file, 0, SEEK_END);
+	bytes.resize(ftell(file));
+	fseek(file, 0, SEEK_SET);
+	if (fread(bytes.data(), 1, bytes.size(), file) != bytes.size()) { bytes.clear(); }
+	fclose(file);
+	return bytes;
+}
+
+// what the loader should produce for an image file, converted here instead of on the worker
+static expected_image expectDecoded(const std::string &filename, int psm, bool dither)
+{
+	expected_image expected = {};
+	int width, height, channels;
+	unsigned int *pixels = (unsigned int *)stbi_load(filename.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+	if (pixels == nullptr) { return expected; }
+	if (psm < 0) { psm = texconv::smallestIndexed(pixels, width, height); }
+	expected.ok = true;
+	expected.layout = texconv::layoutFor(psm, width, height);
+	void *data = memalign(16, expected.layout.data_size);
+	unsigned int *clut = (expected.layout.clut_entries > 0) ? (unsigned int *)memalign(16, expected.layout.clut_entries * 4) : nullptr;
+	texconv::convertImage(pixels, expected.layout, dither, data, clut);
+	expected.data.assign((unsigned char *)data, (unsigned char *)data + expected.layout.data_size);
+	if (clut != nullptr) {
+		expected.clut.assign((unsigned char *)clut, (unsigned char *)clut + expected.layout.clut_entries * 4);
+	}
+	free(data);
+	free(clut);
+	stbi_image_free(pixels);
+	return expected;
+}
+
+// baked files are header, pixels, then the clut
+static expected_image expectBaked(const std::string &filename)
+{
+	expected_image expected = {};
+	std::vector<unsigned char> bytes = readAll(filename);
+	unsigned int header_size = 0;
+	if (!texconv::readHeader(bytes.data(), bytes.size(), expected.layout, header_size)) { return expected; }
+	unsigned int clut_bytes = expected.layout.clut_entries * 4;
+	if (bytes.size() < header_size + expected.layout.data_size + clut_bytes) { return expected; }
+	expected.ok = true;
+	const unsigned char *payload = bytes.data() + header_size;
+	expected.data.assign(payload, payload + expected.layout.data_size);
+	expected.clut.assign(payload + expected.layout.data_size, payload + expected.layout.data_size + clut_bytes);
+	return expected;
+}
+
+static unsigned int checkImage(const char *name, const loaded_image &image, const expected_image &expected)
+{
+	unsigned int failures = 0;
+	if (image.ok != expected.ok) {
+		printf("MISMATCH %s: ok is %d, expected %d\n", name, image.ok, expected.ok);
+		return 1;
+	}
+	if (!image.ok) {
+		if (image.data != nullptr || image.clut != nullptr) {
+			printf("MISMATCH %s: failed load still hands back buffers\n", name);
+			failures++;
+		}
+		return failures;
+	}
+	if (image.layout.psm != expected.layout.psm || image.layout.data_size != expected.layout.data_size ||
+		image.layout.pixel_width != expected.layout.pixel_width || image.layout.pixel_height != expected.layout.pixel_height ||
+		image.layout.clut_entries != expected.layout.clut_entries) {
+		printf("MISMATCH %s: psm %d, %ux%u, %u bytes, %u clut entries, expected psm %d, %ux%u, %u bytes, %u clut entries\n", name,
+			image.layout.psm, image.layout.pixel_width, image.layout.pixel_height, image.layout.data_size, image.layout.clut_entries,
+			expected.layout.psm, expected.layout.pixel_width, expected.layout.pixel_height, expected.layout.data_size, expected.layout.clut_entries);
+		return 1;
+	}
+	if (image.data == nullptr || memcmp(image.data, expected.data.data(), expected.data.size()) != 0) {
+		printf("MISMATCH %s: pixel data differs\n", name);
+		failures++;
+	}
+	if (!expected.clut.empty() && (image.clut == nullptr || memcmp(image.clut, expected.clut.data(), expected.clut.size()) != 0)) {
+		printf("MISMATCH %s: clut differs\n", name);
+		failures++;
+	}
+	return failures;
+}
+
+int main(int argc, char **argv)
+{
+	std::string dir = (argc > 1) ? argv[1] : "..";
+	dir += "/";
+	struct check
+	{
+		const char *name;
+		int psm;
+		bool dither;
+		expected_image expected;
+		unsigned int id;
+		bool polled;
+	};
+	std::vector<check> checks = {
+		{"circle.png", texconv::psm::RGBA8888, false},
+		{"circle.png", texconv::psm::RGBA4444, true},
+		{"spelunky_font.png", -1, false}, // smallest paletted format
+		{"spelunky_font.ntx", -1, false},
+		{"circle.ntx", -1, false},
+		{"missing.png", -1, false},
+	};
+	unsigned int failures = 0;
+	for (check &c : checks) {
+		std::string filename = dir + c.name;
+		bool baked = filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".ntx") == 0;
+		c.expected = baked ? expectBaked(filename) : expectDecoded(filename, c.psm, c.dither);
+		if (!c.expected.ok && strcmp(c.name, "missing.png") != 0) {
+			printf("MISMATCH %s: can't read it here either, run from tools/ or pass the asset directory\n", c.name);
+			failures++;
+		}
+	}
+	if (failures > 0) { return 1; }
+
+	{
+		async_loader loader;
+		for (check &c : checks) {
+			c.id = loader.request(dir + c.name, c.psm, c.dither);
+			c.polled = false;
+		}
+		auto start = std::chrono::steady_clock::now();
+		unsigned int polled = 0;
+		while (polled < checks.size()) {
+			loaded_image image;
+			if (!loader.poll(image)) {
+				if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(LOADER_CHECK_TIMEOUT_MS)) {
+					printf("MISMATCH only %u of %u loads came back\n", polled, (unsigned int)checks.size());
+					return 1;
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				continue;
+			}
+			check *c = nullptr;
+			for (check &candidate : checks) {
+				if (candidate.id == image.id && !candidate.polled) { c = &candidate; }
+			}
+			if (c == nullptr) {
+				printf("MISMATCH poll returned unknown or repeated id %u\n", image.id);
+				failures++;
+			} else {
+				c->polled = true;
+				failures += checkImage(c->name, image, c->expected);
+				printf("%-20s %s psm %d, %u bytes, %.2f ms\n", c->name, image.ok ? "ok" : "failed", image.layout.psm, image.layout.data_size,
+					image.load_us / 1000.0f);
+			}
+			polled++;
+			free(image.data);
+			free(image.clut);
+		}
+		if (loader.getPending() != 0) {
+			printf("MISMATCH %u loads still pending after every result was polled\n", loader.getPending());
+			failures++;
+		}
+	}
+	printf("async_loader check: %s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,151 @@
+/*
+* Host side check and benchmark for texconv::swizzlePadded against the two pass path it replaced (copy every
+* row into a zeroed padded buffer, then texconv::swizzle out of it).
+*
+*   g++ -O2 -std=c++17 -I.. swizzle_bench.cpp ../texconv.cpp -o swizzle_bench
+*   ./swizzle_bench [iterations]
+*
+* Every size and pixel depth below has to come out bit for bit the same as the two pass path, as does
+* texconv::convertImage for 8888 and the 16 bit formats, otherwise it exits with 1. Timings are per conversion.
+*/
+
+#include "texconv.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace nucleus;
+
+struct bench_size
+{
+	unsigned int width, height;
+};
+
+static const bench_size sizes[] = {
+	{1, 1}, {3, 5}, {4, 8}, {17, 9}, {33, 31}, {64, 64}, {100, 7}, {255, 129}, {300, 200}, {480, 272}, {512, 512}, {1000, 3}
+};
+
+static unsigned int random_state = 12345;
+
+static unsigned int nextRandom(void)
+{
+	random_state = random_state * 1664525 + 1013904223;
+	return random_state;
+}
+
+static unsigned int pow2(unsigned int val)
+{
+	unsigned int poweroftwo = 1;
+	while (poweroftwo < val) { poweroftwo <<= 1; }
+	return poweroftwo;
+}
+
+// texture size the runtime would use: power of two, 16 byte rows, whole 8 row blocks
+static void paddedBytes(unsigned int width, unsigned int height, unsigned int bits, unsigned int &row_bytes, unsigned int &rows)
+{
+	row_bytes = std::max(pow2(width) * bits / 8, 16u);
+	rows = std::max(pow2(height), 8u);
+}
+
+static void twoPass(unsigned char *out, const unsigned char *in, unsigned int in_row_bytes, unsigned int in_rows, unsigned int row_bytes,
+	unsigned int rows, std::vector<unsigned char> &padded)
+{
+	padded.assign(row_bytes * rows, 0);
+	for (unsigned int y = 0; y < in_rows; y++) {
+		memcpy(&padded[y * row_bytes], in + y * in_row_bytes, in_row_bytes);
+	}
+	texconv::swizzle(out, padded.data(), row_bytes, rows);
+}
+
+// texconv::convertImage before the fused path: pad the 8888 pixels, convert in place, swizzle
+static void oldConvert(const unsigned int *pixels, const texconv::image_layout &layout, bool dither, unsigned char *out)
+{
+	std::vector<unsigned int> padded(layout.pixel_width * layout.pixel_height, 0);
+	for (unsigned int y = 0; y < layout.height; y++) {
+		memcpy(&padded[y * layout.pixel_width], pixels + y * layout.width, layout.width * 4);
+	}
+	if (layout.psm != texconv::psm::RGBA8888) {
+		texconv::pixel16 format = (layout.psm == texconv::psm::RGB5650) ? texconv::pixel16::RGB5650 :
+			(layout.psm == texconv::psm::RGBA5551) ? texconv::pixel16::RGBA5551 : texconv::pixel16::RGBA4444;
+		texconv::convert16(padded.data(), layout.pixel_width, layout.pixel_height, format, dither, (unsigned short *)padded.data());
+	}
+	texconv::swizzle(out, (const unsigned char *)padded.data(), layout.pixel_width * texconv::bitsPerPixel(layout.psm) / 8, layout.pixel_height);
+}
+
+template <typename F>
+static double millisPer(unsigned int iterations, F run)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < iterations; i++) {
+		run();
+	}
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int iterations = (argc > 1) ? (unsigned int)atoi(argv[1]) : 200;
+	if (iterations == 0) { iterations = 1; }
+	unsigned int failures = 0;
+	std::vector<unsigned char> padded;
+
+	// raw kernel against the two pass path, at every depth the runtime swizzles
+	for (unsigned int bits : {32u, 16u, 8u}) {
+		for (const bench_size &size : sizes) {
+			unsigned int in_row_bytes = size.width * bits / 8, row_bytes, rows;
+			paddedBytes(size.width, size.height, bits, row_bytes, rows);
+			std::vector<unsigned char> in(in_row_bytes * size.height), expected(row_bytes * rows), fused(row_bytes * rows, 0xCD);
+			for (unsigned char &byte : in) { byte = nextRandom() >> 24; }
+			twoPass(expected.data(), in.data(), in_row_bytes, size.height, row_bytes, rows, padded);
+			texconv::swizzlePadded(fused.data(), in.data(), in_row_bytes, size.height, row_bytes, rows);
+			if (expected != fused) {
+				printf("MISMATCH swizzlePadded %ux%u at %u bits\n", size.width, size.height, bits);
+				failures++;
+			}
+		}
+	}
+
+	// whole conversions, the fused path must not change what ends up in texture memory
+	for (int psm : {texconv::psm::RGBA8888, texconv::psm::RGB5650, texconv::psm::RGBA5551, texconv::psm::RGBA4444}) {
+		for (bool dither : {false, true}) {
+			for (const bench_size &size : sizes) {
+				std::vector<unsigned int> pixels(size.width * size.height);
+				for (unsigned int &pixel : pixels) { pixel = nextRandom(); }
+				texconv::image_layout layout = texconv::layoutFor(psm, size.width, size.height);
+				if (layout.pixel_height < 8) { continue; } // neither path swizzles less than one block row
+				std::vector<unsigned char> expected(layout.data_size), converted(layout.data_size, 0xCD);
+				oldConvert(pixels.data(), layout, dither, expected.data());
+				texconv::convertImage(pixels.data(), layout, dither, converted.data(), nullptr);
+				if (expected != converted) {
+					printf("MISMATCH convertImage psm %d%s %ux%u\n", psm, dither ? " dithered" : "", size.width, size.height);
+					failures++;
+				}
+			}
+		}
+	}
+	printf("bit exact check: %s\n", failures ? "FAILED" : "ok");
+
+	printf("%-10s %5s %12s %12s %8s\n", "size", "bits", "two pass ms", "fused ms", "speedup");
+	for (const bench_size &size : {bench_size{480, 272}, bench_size{512, 512}, bench_size{300, 200}}) {
+		for (unsigned int bits : {32u, 16u}) {
+			unsigned int in_row_bytes = size.width * bits / 8, row_bytes, rows;
+			paddedBytes(size.width, size.height, bits, row_bytes, rows);
+			std::vector<unsigned char> in(in_row_bytes * size.height), out(row_bytes * rows);
+			for (unsigned char &byte : in) { byte = nextRandom() >> 24; }
+			double two_pass = millisPer(iterations, [&]() {
+				twoPass(out.data(), in.data(), in_row_bytes, size.height, row_bytes, rows, padded);
+			});
+			double fused = millisPer(iterations, [&]() {
+				texconv::swizzlePadded(out.data(), in.data(), in_row_bytes, size.height, row_bytes, rows);
+			});
+			char name[32];
+			snprintf(name, sizeof(name), "%ux%u", size.width, size.height);
+			printf("%-10s %5u %12.3f %12.3f %7.2fx\n", name, bits, two_pass, fused, two_pass / fused);
+		}
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,108 @@
+/*
+* Host side texture baker, does everything texture::loadTexture would do to an image at runtime and writes
+* the result as a .ntx file that the PSP reads straight into place.
+*
+*   g++ -O2 -std=c++17 -I.. tex_bake.cpp ../texconv.cpp -o tex_bake
+*   ./tex_bake [-f format] [-d] <image> <output.ntx>
+*
+* format is one of 8888 (default), 5650, 5551, 4444, t8, t4, indexed, dxt1, dxt3, dxt5, the same choices as
+* nucleus::texture_format. -d dithers the 16 bit formats.
+*/
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "texconv.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace nucleus;
+
+struct bake_format
+{
+	const char *name;
+	int psm; // -1 for indexed, resolved per image
+};
+
+static const bake_format bake_formats[] = {
+	{"8888", texconv::psm::RGBA8888}, {"5650", texconv::psm::RGB5650}, {"5551", texconv::psm::RGBA5551}, {"4444", texconv::psm::RGBA4444},
+	{"t8", texconv::psm::T8}, {"t4", texconv::psm::T4}, {"indexed", -1},
+	{"dxt1", texconv::psm::DXT1}, {"dxt3", texconv::psm::DXT3}, {"dxt5", texconv::psm::DXT5}
+};
+
+static const char *psmName(int psm)
+{
+	for (const bake_format &format : bake_formats) {
+		if (format.psm == psm) { return format.name; }
+	}
+	return "?";
+}
+
+int main(int argc, char **argv)
+{
+	int psm = texconv::psm::RGBA8888, arg = 1;
+	bool dither = false;
+	while (arg < argc && argv[arg][0] == '-') {
+		if (!strcmp(argv[arg], "-f") && arg + 1 < argc) {
+			const char *name = argv[++arg];
+			psm = -2;
+			for (const bake_format &format : bake_formats) {
+				if (!strcmp(name, format.name)) { psm = format.psm; }
+			}
+			if (psm == -2) {
+				fprintf(stderr, "unknown format %s\n", name);
+				return 1;
+			}
+		} else if (!strcmp(argv[arg], "-d")) {
+			dither = true;
+		}
+		arg++;
+	}
+	if (argc - arg != 2) {
+		fprintf(stderr, "usage: %s [-f format] [-d] <image> <output.ntx>\n", argv[0]);
+		return 1;
+	}
+
+	int width, height, channels;
+	unsigned int *pixels = (unsigned int *)stbi_load(argv[arg], &width, &height, &channels, STBI_rgb_alpha);
+	if (!pixels) {
+		fprintf(stderr, "unable to load %s\n", argv[arg]);
+		return 1;
+	}
+	if (psm == -1) { // smallest exact paletted format, like texture_format::INDEXED
+		psm = texconv::smallestIndexed(pixels, width, height);
+	}
+
+	texconv::image_layout layout = texconv::layoutFor(psm, width, height);
+	std::vector<unsigned char> data(layout.data_size);
+	std::vector<unsigned int> clut(layout.clut_entries);
+	texconv::convertImage(pixels, layout, dither, data.data(), clut.data());
+	stbi_image_free(pixels);
+	unsigned int pixel_width = layout.pixel_width, pixel_height = layout.pixel_height, data_size = layout.data_size;
+
+	texconv::ntx_header header = {};
+	header.magic = TEXCONV_NTX_MAGIC;
+	header.version = TEXCONV_NTX_VERSION;
+	header.psm = psm;
+	header.width = width, header.height = height;
+	header.pixel_width = pixel_width, header.pixel_height = pixel_height;
+	header.flags = layout.swizzled ? TEXCONV_NTX_SWIZZLED : 0;
+	header.data_size = data_size;
+	header.clut_entries = clut.size();
+	FILE *f = fopen(argv[arg + 1], "wb");
+	if (!f) {
+		fprintf(stderr, "unable to write %s\n", argv[arg + 1]);
+		return 1;
+	}
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(data.data(), 1, data.size(), f);
+	if (!clut.empty()) {
+		fwrite(clut.data(), 4, clut.size(), f);
+	}
+	fclose(f);
+
+	printf("%s: %s %ux%u, %u bytes (%u as 8888)\n", argv[arg + 1], psmName(psm), pixel_width, pixel_height,
+		data_size + (unsigned int)clut.size() * 4, pixel_width * pixel_height * 4);
+	return 0;
+}
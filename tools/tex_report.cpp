@@ -0,0 +1,148 @@
+/*
+* Host side texture memory report, compares what each nucleus::texture_format costs for a set of images.
+*
+*   g++ -O2 -std=c++17 -I.. tex_report.cpp ../texconv.cpp -o tex_report
+*   ./tex_report <image>...
+*
+* Sizes are for the padded (power of two) texture the PSP ends up holding, including the CLUT for T4/T8.
+* Error is the RMS difference per channel (0-255) against the source, dithered 16 bit formats are marked with 'd'.
+* DXT blocks go through texconv's own decoder, which follows the GE's block layout.
+*/
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "texconv.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace nucleus;
+
+struct report_format
+{
+	const char *name;
+	unsigned int bits;
+	int kind; // 0 8888, 1 16 bit, 2 paletted, 3 DXT
+	texconv::pixel16 format16;
+	bool dither;
+	unsigned int colors;
+	texconv::dxt compressed;
+};
+
+static const report_format formats[] = {
+	{"8888", 32, 0, texconv::pixel16::RGB5650, false, 0, texconv::dxt::DXT1},
+	{"5650", 16, 1, texconv::pixel16::RGB5650, false, 0, texconv::dxt::DXT1},
+	{"5650d", 16, 1, texconv::pixel16::RGB5650, true, 0, texconv::dxt::DXT1},
+	{"5551", 16, 1, texconv::pixel16::RGBA5551, false, 0, texconv::dxt::DXT1},
+	{"5551d", 16, 1, texconv::pixel16::RGBA5551, true, 0, texconv::dxt::DXT1},
+	{"4444", 16, 1, texconv::pixel16::RGBA4444, false, 0, texconv::dxt::DXT1},
+	{"4444d", 16, 1, texconv::pixel16::RGBA4444, true, 0, texconv::dxt::DXT1},
+	{"T8", 8, 2, texconv::pixel16::RGB5650, false, TEXCONV_T8_COLORS, texconv::dxt::DXT1},
+	{"T4", 4, 2, texconv::pixel16::RGB5650, false, TEXCONV_T4_COLORS, texconv::dxt::DXT1},
+	{"DXT1", 4, 3, texconv::pixel16::RGB5650, false, 0, texconv::dxt::DXT1},
+	{"DXT3", 8, 3, texconv::pixel16::RGB5650, false, 0, texconv::dxt::DXT3},
+	{"DXT5", 8, 3, texconv::pixel16::RGB5650, false, 0, texconv::dxt::DXT5},
+};
+#define N_REPORT_FORMATS (sizeof(formats) / sizeof(formats[0]))
+
+static unsigned int pow2(unsigned int val)
+{
+	unsigned int poweroftwo = 1;
+	while (poweroftwo < val) { poweroftwo <<= 1; }
+	return poweroftwo;
+}
+
+static double channelError(unsigned int a, unsigned int b)
+{
+	double sum = 0.0;
+	for (unsigned int c = 0; c < 4; c++) {
+		double d = (double)((a >> (c * 8)) & 0xFF) - (double)((b >> (c * 8)) & 0xFF);
+		sum += d * d;
+	}
+	return sum;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <image>...\n", argv[0]);
+		return 1;
+	}
+	unsigned int totals[N_REPORT_FORMATS] = {};
+	printf("%-24s %9s %7s", "image", "size", "colors");
+	for (const report_format &f : formats) {
+		printf(" %13s", f.name);
+	}
+	printf("\n");
+
+	for (int arg = 1; arg < argc; arg++) {
+		int width, height, channels;
+		unsigned int *pixels = (unsigned int *)stbi_load(argv[arg], &width, &height, &channels, STBI_rgb_alpha);
+		if (!pixels) {
+			fprintf(stderr, "unable to load %s\n", argv[arg]);
+			return 1;
+		}
+		unsigned int count = width * height;
+		// fully transparent pixels compare equal whatever their color bits, same as the converters treat them
+		for (unsigned int i = 0; i < count; i++) {
+			if ((pixels[i] >> 24) == 0) { pixels[i] = 0; }
+		}
+		char size[32];
+		snprintf(size, sizeof(size), "%ux%u", pow2(width), pow2(height));
+		printf("%-24s %9s %7u", argv[arg], size, texconv::countColors(pixels, count, 65536));
+
+		for (unsigned int f = 0; f < N_REPORT_FORMATS; f++) {
+			const report_format &format = formats[f];
+			// rows are padded to 16 bytes, the same as texture::loadTexture does
+			unsigned int padded_width = pow2(width);
+			if (format.kind != 3 && padded_width * format.bits < 128) { padded_width = 128 / format.bits; }
+			unsigned int bytes = padded_width * pow2(height) * format.bits / 8 + format.colors * 4;
+			totals[f] += bytes;
+
+			double error = 0.0;
+			if (format.kind == 1) {
+				std::vector<unsigned short> converted(count);
+				texconv::convert16(pixels, width, height, format.format16, format.dither, converted.data());
+				for (unsigned int i = 0; i < count; i++) {
+					unsigned int expanded = texconv::expand16(converted[i], format.format16);
+					error += channelError(pixels[i], (expanded >> 24) ? expanded : 0);
+				}
+			} else if (format.kind == 2) {
+				std::vector<unsigned int> palette(format.colors);
+				std::vector<unsigned char> indices(count);
+				texconv::quantize(pixels, count, palette.data(), format.colors, indices.data());
+				for (unsigned int i = 0; i < count; i++) {
+					error += channelError(pixels[i], palette[indices[i]]);
+				}
+			} else if (format.kind == 3) {
+				// blocks cover the padded size, padding is transparent like in texture::loadTexture
+				unsigned int block_width = std::max(pow2(width), 4u), block_height = std::max(pow2(height), 4u);
+				std::vector<unsigned int> padded(block_width * block_height, 0), decoded(block_width * block_height);
+				for (int y = 0; y < height; y++) {
+					std::copy(pixels + y * width, pixels + (y + 1) * width, padded.begin() + y * block_width);
+				}
+				texconv::encodeDXT(padded.data(), block_width, block_height, format.compressed, decoded.data()); // blocks are smaller than the pixels
+				std::vector<unsigned int> blocks(decoded.begin(), decoded.begin() + texconv::dxtSize(block_width, block_height, format.compressed) / 4);
+				texconv::decodeDXT(blocks.data(), block_width, block_height, format.compressed, decoded.data());
+				for (int y = 0; y < height; y++) {
+					for (int x = 0; x < width; x++) {
+						unsigned int expanded = decoded[x + y * block_width];
+						error += channelError(pixels[x + y * width], (expanded >> 24) ? expanded : 0);
+					}
+				}
+			}
+			printf(" %6uK %6.2f", bytes / 1024, sqrt(error / (count * 4.0)));
+		}
+		printf("\n");
+		stbi_image_free(pixels);
+	}
+
+	printf("%-24s %9s %7s", "total", "", "");
+	for (unsigned int f = 0; f < N_REPORT_FORMATS; f++) {
+		printf(" %6uK %6s", totals[f] / 1024, "");
+	}
+	printf("\n");
+	return 0;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <pspgu.h>
+
+#include <cstddef>
+
+/*
+* Compile time description of GE vertex layouts. The GE reads the attributes of a vertex in the order
+* uv, color, normal, position, each aligned to the size of its component type, with the whole vertex
+* padded to its largest component. vertex_format computes the vertex type word and the layout the GE
+* expects, so a struct can be checked against it with static_assert instead of trusting hand kept flags.
+*/
+
+namespace nucleus
+{
+	namespace vf
+	{
+		constexpr unsigned int alignUp(unsigned int offset, unsigned int alignment)
+		{
+			return (offset + alignment - 1) & ~(alignment - 1);
+		}
+
+		template<typename T, unsigned int N, int Flag>
+		struct attribute
+		{
+			using component = T;
+			using storage = T[N];
+			static constexpr unsigned int size = sizeof(T) * N;
+			static constexpr unsigned int alignment = sizeof(T);
+			static constexpr int flag = Flag;
+		};
+
+		template<typename T, int Flag>
+		struct packed_color // colors are a single packed integer instead of an array
+		{
+			using component = T;
+			using storage = T;
+			static constexpr unsigned int size = sizeof(T);
+			static constexpr unsigned int alignment = sizeof(T);
+			static constexpr int flag = Flag;
+		};
+
+		struct none // attribute not present in the vertex
+		{
+			using storage = unsigned char[0];
+			static constexpr unsigned int size = 0;
+			static constexpr unsigned int alignment = 1;
+			static constexpr int flag = 0;
+		};
+
+		// texture coordinates are unsigned, 8 bit is 128 = 1.0 and 16 bit is 32768 = 1.0 (texels in GU_TRANSFORM_2D)
+		using uv_f32 = attribute<float, 2, GU_TEXTURE_32BITF>;
+		using uv_u16 = attribute<unsigned short, 2, GU_TEXTURE_16BIT>;
+		using uv_u8 = attribute<unsigned char, 2, GU_TEXTURE_8BIT>;
+
+		using color_8888 = packed_color<unsigned int, GU_COLOR_8888>;
+		using color_5650 = packed_color<unsigned short, GU_COLOR_5650>;
+		using color_5551 = packed_color<unsigned short, GU_COLOR_5551>;
+		using color_4444 = packed_color<unsigned short, GU_COLOR_4444>;
+
+		using normal_f32 = attribute<float, 3, GU_NORMAL_32BITF>;
+		using normal_s16 = attribute<short, 3, GU_NORMAL_16BIT>;
+		using normal_s8 = attribute<signed char, 3, GU_NORMAL_8BIT>;
+
+		// fixed point positions are normalized (32767 = 1.0) in GU_TRANSFORM_3D and plain integers in GU_TRANSFORM_2D
+		using pos_f32 = attribute<float, 3, GU_VERTEX_32BITF>;
+		using pos_s16 = attribute<short, 3, GU_VERTEX_16BIT>;
+		using pos_s8 = attribute<signed char, 3, GU_VERTEX_8BIT>;
+
+		constexpr unsigned int largest(unsigned int a, unsigned int b) { return a > b ? a : b; }
+	}
+
+	template<typename UV, typename Color, typename Normal, typename Position>
+	struct vertex_format
+	{
+		static_assert(Position::size != 0, "every GE vertex needs a position");
+
+		// OR with GU_TRANSFORM_2D/3D and an index type when drawing
+		static constexpr int vtype = UV::flag | Color::flag | Normal::flag | Position::flag;
+
+		static constexpr unsigned int uv_offset = 0;
+		static constexpr unsigned int color_offset = vf::alignUp(uv_offset + UV::size, Color::alignment);
+		static constexpr unsigned int normal_offset = vf::alignUp(color_offset + Color::size, Normal::alignment);
+		static constexpr unsigned int position_offset = vf::alignUp(normal_offset + Normal::size, Position::alignment);
+		static constexpr unsigned int alignment = vf::largest(vf::largest(UV::alignment, Color::alignment), vf::largest(Normal::alignment, Position::alignment));
+		static constexpr unsigned int size = vf::alignUp(position_offset + Position::size, alignment);
+	};
+
+	/*
+	* Vertex struct generated from its attribute types, absent attributes take no space.
+	* e.g. gu_vertex<vf::uv_u8, vf::none, vf::none, vf::pos_s16> is a 8 byte textured vertex
+	*/
+	template<typename UV, typename Color, typename Normal, typename Position>
+	struct gu_vertex
+	{
+		using format = vertex_format<UV, Color, Normal, Position>;
+		typename UV::storage uv;
+		typename Color::storage color;
+		typename Normal::storage normal;
+		typename Position::storage position;
+	};
+}
+
+// checks a vertex struct against its 'format' member, use at namespace scope after the struct
+#define NUCLEUS_CHECK_VERTEX(type) \
+	static_assert(sizeof(type) == type::format::size, #type " size does not match its GE vertex format"); \
+	static_assert(alignof(type) == type::format::alignment, #type " alignment does not match its GE vertex format")
+
+#define NUCLEUS_CHECK_VERTEX_MEMBER(type, attrib, member) \
+	static_assert(offsetof(type, member) == type::format::attrib##_offset, #type "::" #member " is not where the GE reads " #attrib)
@@ -0,0 +1,176 @@
+#include "vram.h"
+#include "nucleus.h"
+
+#include <cstring>
+
+namespace nucleus
+{
+	namespace vram
+	{
+		struct block
+		{
+			unsigned int offset, size; // from the start of EDRAM
+			unsigned int alignment; // kept so compaction doesn't break it
+			bool used;
+			void **owner;
+		};
+
+		// sorted by offset, neighbours in the array are neighbours in memory
+		static block blocks[VRAM_MAX_BLOCKS];
+		static unsigned int n_blocks = 0;
+
+		static void init(void)
+		{
+			if (n_blocks > 0) { return; }
+			blocks[0] = {0, sceGeEdramGetSize(), VRAM_ALIGNMENT, false, nullptr};
+			n_blocks = 1;
+		}
+
+		static unsigned char *base(void)
+		{
+			return (unsigned char *)sceGeEdramGetAddr();
+		}
+
+		static bool insertBlock(unsigned int index, const block &b)
+		{
+			if (n_blocks >= VRAM_MAX_BLOCKS) { return false; }
+			memmove(&blocks[index + 1], &blocks[index], (n_blocks - index) * sizeof(block));
+			blocks[index] = b;
+			n_blocks++;
+			return true;
+		}
+
+		static void removeBlock(unsigned int index)
+		{
+			memmove(&blocks[index], &blocks[index + 1], (n_blocks - index - 1) * sizeof(block));
+			n_blocks--;
+		}
+
+		static int findBlock(void *ptr)
+		{
+			unsigned int offset = (unsigned char *)ptr - base();
+			for (unsigned int i = 0; i < n_blocks; i++) {
+				if (blocks[i].used && blocks[i].offset == offset) { return i; }
+			}
+			return -1;
+		}
+
+		void *allocate(unsigned int size, unsigned int alignment, void **owner)
+		{
+			init();
+			size = (size + VRAM_ALIGNMENT - 1) & ~(VRAM_ALIGNMENT - 1);
+			for (unsigned int i = 0; i < n_blocks; i++) {
+				if (blocks[i].used) { continue; }
+				unsigned int start = (blocks[i].offset + alignment - 1) & ~(alignment - 1);
+				unsigned int padding = start - blocks[i].offset;
+				if (blocks[i].size < padding + size) { continue; }
+
+				// split off the alignment padding in front and the remainder behind as free blocks
+				if (padding > 0) {
+					if (!insertBlock(i, {blocks[i].offset, padding, VRAM_ALIGNMENT, false, nullptr})) { break; }
+					i++;
+					blocks[i].offset += padding, blocks[i].size -= padding;
+				}
+				if (blocks[i].size > size) {
+					if (!insertBlock(i + 1, {start + size, blocks[i].size - size, VRAM_ALIGNMENT, false, nullptr})) { break; }
+				}
+				blocks[i] = {start, size, alignment, true, owner};
+				return base() + start;
+			}
+			char buff[128];
+			sprintf(buff, "VRAM allocation of %u bytes failed!", size);
+			writeToLog(buff);
+			return nullptr;
+		}
+
+		void release(void *ptr)
+		{
+			if (ptr == nullptr) { return; }
+			int i = findBlock(ptr);
+			if (i < 0) {
+				writeToLog("Released a pointer that isn't a VRAM allocation!");
+				return;
+			}
+			blocks[i].used = false, blocks[i].owner = nullptr;
+			// coalesce with the free neighbours
+			if (i + 1 < (int)n_blocks && !blocks[i + 1].used) {
+				blocks[i].size += blocks[i + 1].size;
+				removeBlock(i + 1);
+			}
+			if (i > 0 && !blocks[i - 1].used) {
+				blocks[i - 1].size += blocks[i].size;
+				removeBlock(i);
+			}
+		}
+
+		void setOwner(void *ptr, void **owner)
+		{
+			int i = findBlock(ptr);
+			if (i >= 0) {
+				blocks[i].owner = owner;
+			}
+		}
+
+		unsigned int compact(void)
+		{
+			init();
+			// blocks only ever move down, into the free space directly below them
+			unsigned int moved = 0;
+			for (unsigned int i = 1; i < n_blocks; i++) {
+				if (!blocks[i].used || blocks[i].owner == nullptr || blocks[i - 1].used) { continue; }
+				block &gap = blocks[i - 1];
+				block &b = blocks[i];
+				unsigned int new_offset = (gap.offset + b.alignment - 1) & ~(b.alignment - 1);
+				if (new_offset >= b.offset) { continue; }
+
+				// copy through the uncached mirror so no stale cache lines get written back over it later
+				unsigned char *uncached = (unsigned char *)((unsigned int)base() | 0x40000000);
+				memmove(uncached + new_offset, uncached + b.offset, b.size);
+				*b.owner = base() + new_offset;
+
+				unsigned int shift = b.offset - new_offset;
+				b.offset = new_offset;
+				gap.size -= shift;
+				// the freed space now sits above the block, merge it with whatever free block follows
+				if (i + 1 < n_blocks && !blocks[i + 1].used) {
+					blocks[i + 1].offset -= shift, blocks[i + 1].size += shift;
+				} else if (!insertBlock(i + 1, {b.offset + b.size, shift, VRAM_ALIGNMENT, false, nullptr})) {
+					b.size += shift; // out of block slots, keep the space attached to the block
+				}
+				if (gap.size == 0) {
+					removeBlock(i - 1);
+					i--;
+				}
+				moved++;
+			}
+			return moved;
+		}
+
+		vram_stats getStats(void)
+		{
+			init();
+			vram_stats stats = {};
+			for (unsigned int i = 0; i < n_blocks; i++) {
+				if (blocks[i].used) {
+					stats.used += blocks[i].size;
+					stats.used_blocks++;
+				} else {
+					stats.free += blocks[i].size;
+					stats.free_blocks++;
+					stats.largest_free = blocks[i].size > stats.largest_free ? blocks[i].size : stats.largest_free;
+				}
+			}
+			stats.fragmentation = (stats.free > 0) ? 1.0f - (float)stats.largest_free / stats.free : 0.0f;
+			return stats;
+		}
+
+		void logStats(void)
+		{
+			vram_stats stats = getStats();
+			char buff[256];
+			sprintf(buff, "VRAM: %u used in %u blocks, %u free in %u blocks, largest free %u, fragmentation %.2f",
+				stats.used, stats.used_blocks, stats.free, stats.free_blocks, stats.largest_free, stats.fragmentation);
+			writeToLog(buff);
+		}
+	}
+}
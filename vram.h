@@ -0,0 +1,33 @@
+#pragma once
+#include <pspge.h>
+
+#define VRAM_ALIGNMENT 16 // texture, CLUT and framebuffer addresses the GE accepts
+#define VRAM_MAX_BLOCKS 256 // used and free blocks together
+
+namespace nucleus
+{
+	struct vram_stats
+	{
+		unsigned int used, free; // bytes
+		unsigned int largest_free; // biggest single allocation that would currently succeed
+		unsigned int used_blocks, free_blocks;
+		float fragmentation; // 0 when all free memory is one block, approaching 1 as it splinters
+	};
+
+	/*
+	* First fit heap over EDRAM with coalescing of neighbouring free blocks. Addresses handed out are
+	* absolute (sceGeEdramGetAddr() based). An allocation can name an owner pointer, which compact() rewrites
+	* when it moves the block. Blocks without an owner (framebuffers) never move.
+	*/
+	namespace vram
+	{
+		void *allocate(unsigned int size, unsigned int alignment = VRAM_ALIGNMENT, void **owner = nullptr);
+		void release(void *ptr);
+		void setOwner(void *ptr, void **owner); // owner may be nullptr to pin the block
+		// slides movable blocks down to close gaps, the GE must be idle and anything holding the old
+		// addresses other than the owner (recorded static_lists, state cache) is stale afterwards
+		unsigned int compact(void); // returns the number of blocks moved
+		vram_stats getStats(void);
+		void logStats(void);
+	}
+}